@@ -0,0 +1,244 @@
+#include <vector>
+#include <algorithm>
+#include "board.hpp"
+#include "batchgen.hpp"
+#include "movegen.hpp"
+#include "constants.hpp"
+
+PositionBatch::PositionBatch(BoardType board_type): board_type(board_type) {}
+
+int PositionBatch::size() const {
+    return this->to_play.size();
+}
+
+void PositionBatch::add(const BoardData &data) {
+
+    for (int c=0; c<2; c++) this->color_bb[c].push_back(data.color_bb[c]);
+    for (int p=0; p<5; p++) this->piece_bb[p].push_back(data.piece_bb[p]);
+    this->to_play.push_back(coloridx(data.player_to_play));
+}
+
+void PositionBatch::clear() {
+
+    for (int c=0; c<2; c++) this->color_bb[c].clear();
+    for (int p=0; p<5; p++) this->piece_bb[p].clear();
+    this->to_play.clear();
+}
+
+// What the king's safety allows the other pieces of a position to do,
+// computed once per position before any moves are generated (see
+// gen_legal_moves in board.cpp for the rules).
+struct KingSafety {
+    U8 king;         // square of the king to play, DEAD if it has none
+    bool exact;      // an enemy slider has two paths to the king: test each move
+    U64 check_mask;  // squares a non-king move must land on
+    U64 pinned;      // our pieces pinned to the king
+};
+
+// A piece's targets, kept between counting the moves of a batch and writing
+// them out.
+struct BatchTargets {
+    int pos;
+    U8 src;
+    bool pawn;
+    U64 targets;
+};
+
+// Writes moves to consecutive U16s, for construct_moves.
+struct MoveSink {
+    U16 *out;
+    void push(U16 m) { *out++ = m; }
+};
+
+// Gathers the piece bitboards of position i into BoardData order, for the
+// attack functions of movegen.hpp.
+inline void gather_piece_bb(const PositionBatch &batch, int i, U64 *piece_bb) {
+    for (int p=0; p<5; p++) piece_bb[p] = batch.piece_bb[p][i];
+}
+
+// The line a pinned piece on s must stay on: the squares between the king
+// and each slider pinning it, and the slider itself.
+template <BoardType BT>
+U64 pin_line(const PositionBatch &batch, int i, U8 king, U8 s, U64 them, U64 occ) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    const U64 sliders[2] = {
+        them & batch.piece_bb[pieceidx(ROOK)][i],
+        them & batch.piece_bb[pieceidx(BISHOP)][i]
+    };
+
+    U64 line = ~0ULL;
+    for (int piece : {RAY_ROOK, RAY_BISHOP}) {
+        U64 candidates = geom.slider_sources[piece][king] & sliders[piece];
+        while (candidates) {
+            U8 c = pop_lsb(candidates);
+            U64 between = geom.between[piece][c][king];
+            if ((between & occ) == sqbit(s)) line &= between | sqbit(c);
+        }
+    }
+    return line;
+}
+
+template <BoardType BT>
+KingSafety king_safety(const PositionBatch &batch, int i) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    U8 color = batch.to_play[i];
+    U64 us = batch.color_bb[color][i];
+    U64 them = batch.color_bb[color ^ 1][i];
+    U64 occ = us | them;
+    U64 kings = us & batch.piece_bb[pieceidx(KING)][i];
+
+    KingSafety ks = {DEAD, false, ~0ULL, 0};
+    if (!kings) return ks;
+    ks.king = lsb(kings);
+
+    U64 rooks = them & batch.piece_bb[pieceidx(ROOK)][i];
+    U64 bishops = them & batch.piece_bb[pieceidx(BISHOP)][i];
+    if constexpr (geom.n_alt_paths > 0) {
+        if ((geom.alt_sources[RAY_ROOK][ks.king] & rooks) | (geom.alt_sources[RAY_BISHOP][ks.king] & bishops)) {
+            ks.exact = true;
+            return ks;
+        }
+    }
+
+    U64 piece_bb[5];
+    gather_piece_bb(batch, i, piece_bb);
+    U64 checkers = attackers_of<BT>(piece_bb, ks.king, them, occ);
+    while (checkers) {
+        // every checker must be captured or blocked; in double check one
+        // move can only do both where the two rays cross
+        U8 c = pop_lsb(checkers);
+        U64 mask = sqbit(c);
+        if (rooks & sqbit(c)) mask |= geom.between[RAY_ROOK][c][ks.king];
+        if (bishops & sqbit(c)) mask |= geom.between[RAY_BISHOP][c][ks.king];
+        ks.check_mask &= mask;
+    }
+
+    const U64 sliders[2] = {rooks, bishops};
+    for (int piece : {RAY_ROOK, RAY_BISHOP}) {
+        U64 candidates = geom.slider_sources[piece][ks.king] & sliders[piece];
+        while (candidates) {
+            U64 blockers = geom.between[piece][pop_lsb(candidates)][ks.king] & occ;
+            if (popcnt(blockers) == 1) ks.pinned |= blockers & us;
+        }
+    }
+
+    return ks;
+}
+
+// Finds the legal targets of every piece of type P to play in positions
+// first .. last - 1, appends them to found and adds their move counts to
+// counts. safety and counts are indexed from first.
+template <BoardType BT, PieceType P>
+void gen_batch_targets(const PositionBatch &batch, int first, int last, const KingSafety *safety,
+        BatchTargets *found, int &n_found, int *counts) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    const std::vector<U64> &pieces = batch.piece_bb[pieceidx(P)];
+
+    for (int i=first; i<last; i++) {
+        U8 color = batch.to_play[i];
+        U64 us = batch.color_bb[color][i];
+        U64 bb = pieces[i] & us;
+        if (!bb) continue;
+
+        U64 them = batch.color_bb[color ^ 1][i];
+        U64 occ = us | them;
+        const KingSafety &ks = safety[i - first];
+        U64 piece_bb[5];
+        gather_piece_bb(batch, i, piece_bb);
+
+        while (bb) {
+            U8 s = pop_lsb(bb);
+            U64 targets;
+            if constexpr (P == KING)        targets = geom.king_moves[s];
+            else if constexpr (P == KNIGHT) targets = geom.knight_moves[s];
+            else if constexpr (P == PAWN)   targets = geom.pawn_moves[s];
+            else if constexpr (P == ROOK)   targets = slider_attacks<BT, RAY_ROOK>(s, occ);
+            else                            targets = slider_attacks<BT, RAY_BISHOP>(s, occ);
+            targets &= ~us;
+
+            if (P == KING || ks.exact) {
+                // test each target against the position after the move
+                U8 king = (P == KING) ? s : ks.king;
+                U64 legal = 0, bb_t = targets;
+                while (bb_t) {
+                    U8 t = pop_lsb(bb_t);
+                    U8 k = (P == KING) ? t : king;
+                    if (!square_attacked<BT>(piece_bb, k, them & ~sqbit(t), (occ ^ sqbit(s)) | sqbit(t))) {
+                        legal |= sqbit(t);
+                    }
+                }
+                targets = legal;
+            }
+            else if (ks.king != DEAD) {
+                targets &= ks.check_mask;
+                if (ks.pinned & sqbit(s)) targets &= pin_line<BT>(batch, i, ks.king, s, them, occ);
+            }
+            if (!targets) continue;
+
+            counts[i - first] += popcnt(targets);
+            if (P == PAWN) counts[i - first] += popcnt(targets & geom.pawn_promo[color][s]);
+            found[n_found++] = {i, s, P == PAWN, targets};
+        }
+    }
+}
+
+// batch move generation, a chunk of positions at a time so the scratch
+// arrays stay in cache:
+// - compute check and pin masks of every position
+// - for each piece type, find the targets of those pieces in every position
+//   and count the moves they make
+// - lay out the move buffer from the counts and write the moves with the
+//   same construct_* functions Board uses
+static const int batch_chunk = 256;
+
+template <BoardType BT>
+void gen_batch_moves(const PositionBatch &batch, MoveBatch &out) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    int n = batch.size();
+
+    out.counts.assign(n, 0);
+    out.offsets.resize(n + 1);
+    out.offsets[0] = 0;
+    out.moves.clear();
+
+    KingSafety safety[batch_chunk];
+    BatchTargets found[batch_chunk * BoardData::n_pieces];
+    MoveSink sinks[batch_chunk];
+
+    for (int first=0; first<n; first+=batch_chunk) {
+        int last = std::min(n, first + batch_chunk);
+        int *counts = out.counts.data() + first;
+
+        for (int i=first; i<last; i++) safety[i - first] = king_safety<BT>(batch, i);
+
+        int n_found = 0;
+        gen_batch_targets<BT, KING>(batch, first, last, safety, found, n_found, counts);
+        gen_batch_targets<BT, KNIGHT>(batch, first, last, safety, found, n_found, counts);
+        gen_batch_targets<BT, PAWN>(batch, first, last, safety, found, n_found, counts);
+        gen_batch_targets<BT, ROOK>(batch, first, last, safety, found, n_found, counts);
+        gen_batch_targets<BT, BISHOP>(batch, first, last, safety, found, n_found, counts);
+
+        for (int i=first; i<last; i++) out.offsets[i + 1] = out.offsets[i] + out.counts[i];
+        out.moves.resize(out.offsets[last]);
+        for (int i=first; i<last; i++) sinks[i - first].out = out.moves.data() + out.offsets[i];
+
+        for (int j=0; j<n_found; j++) {
+            const BatchTargets &f = found[j];
+            if (f.pawn) {
+                construct_pawn_moves(nullptr, f.src, f.targets,
+                        geom.pawn_promo[batch.to_play[f.pos]][f.src], sinks[f.pos - first]);
+            }
+            else {
+                construct_moves(nullptr, f.src, f.targets, sinks[f.pos - first]);
+            }
+        }
+    }
+}
+
+void generate_batch_moves(const PositionBatch &batch, MoveBatch &out) {
+    DISPATCH_BOARD_TYPE(batch.board_type, gen_batch_moves, batch, out);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "bdata.hpp"
+#include "constants.hpp"
+
+/**
+ * The PositionBatch struct holds many positions of one board type in
+ * structure-of-arrays form: for every bitboard of BoardData one array with an
+ * entry per position. Move generation over a batch walks these arrays instead
+ * of one BoardData at a time, so it touches only the bitboards it needs.
+ */
+struct PositionBatch {
+
+  BoardType board_type;
+
+  // color_bb[c][i] and piece_bb[p][i] are the color_bb[c] / piece_bb[p] of
+  // position i (see BoardData).
+  std::vector<U64> color_bb[2];
+  std::vector<U64> piece_bb[5];
+
+  // coloridx of the player to play in each position.
+  std::vector<U8> to_play;
+
+  /**
+   * @brief Constructor.
+   *
+   * @param board_type - board type shared by all positions of the batch.
+   */
+  PositionBatch(BoardType board_type);
+
+  /**
+   * @brief Number of positions in the batch.
+   */
+  int size() const;
+
+  /**
+   * @brief Appends a position. Its board type must be the batch's.
+   */
+  void add(const BoardData &data);
+
+  /**
+   * @brief Removes all positions, keeping the allocated memory.
+   */
+  void clear();
+};
+
+/**
+ * The MoveBatch struct holds the moves generated for a PositionBatch in one
+ * flat buffer: the moves of position i are moves[offsets[i] ..
+ * offsets[i] + counts[i]), and offsets[size] is the total.
+ */
+struct MoveBatch {
+
+  std::vector<int> counts;
+  std::vector<int> offsets;
+  std::vector<U16> moves;
+
+  /**
+   * @brief Pointer to the first move of position i.
+   */
+  const U16 *moves_of(int i) const { return this->moves.data() + this->offsets[i]; }
+};
+
+/**
+ * @brief Generates the legal moves of every position in a batch.
+ *
+ * Each position gets the same set of moves as Board::get_legal_moves, but
+ * grouped by piece type (king, knights, pawns, rooks, bishops) rather than
+ * in slot order. out is resized to fit and may be reused between calls to
+ * avoid reallocation.
+ *
+ * @param batch The positions.
+ * @param out Receives the move counts and moves.
+ */
+void generate_batch_moves(const PositionBatch &batch, MoveBatch &out);
@@ -2,9 +2,11 @@
 #include <algorithm>
 #include <cstring>
 #include "board.hpp"
+#include "bgeom.hpp"
+#include "zobrist.hpp"
 #include "constants.hpp"
 
-void rotate_board(U8 *src, U8 *tgt, const U8 *transform) {
+void rotate_board(const U8 *src, U8 *tgt, const U8 *transform) {
 
     for (int i=0; i<64; i++) {
         tgt[transform[i]] = src[i];
@@ -13,53 +15,55 @@ void rotate_board(U8 *src, U8 *tgt, const U8 *transform) {
 
 void BoardData::set_pieces_on_board() {
 
-    if (this->b_rook_1   != DEAD) this->board_0[this->b_rook_1]   = BLACK | ROOK ;
-    if (this->b_rook_2   != DEAD) this->board_0[this->b_rook_2]   = BLACK | ROOK ;
-    if (this->b_king     != DEAD) this->board_0[this->b_king]     = BLACK | KING ;
-    if (this->b_bishop   != DEAD) this->board_0[this->b_bishop]   = BLACK | BISHOP ;
-    if (this->b_knight_1 != DEAD) this->board_0[this->b_knight_1] = BLACK | KNIGHT ;
-    if (this->b_knight_2 != DEAD) this->board_0[this->b_knight_2] = BLACK | KNIGHT ;
-    if (this->b_pawn_1   != DEAD) this->board_0[this->b_pawn_1]   = BLACK | PAWN ;
-    if (this->b_pawn_2   != DEAD) this->board_0[this->b_pawn_2]   = BLACK | PAWN ;
-    if (this->b_pawn_3   != DEAD) this->board_0[this->b_pawn_3]   = BLACK | PAWN ;
-    if (this->b_pawn_4   != DEAD) this->board_0[this->b_pawn_4]   = BLACK | PAWN ;
-
-    if (this->w_rook_1   != DEAD) this->board_0[this->w_rook_1]   = WHITE | ROOK ;
-    if (this->w_rook_2   != DEAD) this->board_0[this->w_rook_2]   = WHITE | ROOK ;
-    if (this->w_king     != DEAD) this->board_0[this->w_king]     = WHITE | KING ;
-    if (this->w_bishop   != DEAD) this->board_0[this->w_bishop]   = WHITE | BISHOP ;
-    if (this->w_knight_1 != DEAD) this->board_0[this->w_knight_1] = WHITE | KNIGHT ;
-    if (this->w_knight_2 != DEAD) this->board_0[this->w_knight_2] = WHITE | KNIGHT ;
-    if (this->w_pawn_1   != DEAD) this->board_0[this->w_pawn_1]   = WHITE | PAWN ;
-    if (this->w_pawn_2   != DEAD) this->board_0[this->w_pawn_2]   = WHITE | PAWN ;
-    if (this->w_pawn_3   != DEAD) this->board_0[this->w_pawn_3]   = WHITE | PAWN ;
-    if (this->w_pawn_4   != DEAD) this->board_0[this->w_pawn_4]   = WHITE | PAWN ;
-
-    rotate_board(this->board_0, this->board_90, this->transform_array[1]);
-    rotate_board(this->board_0, this->board_180, this->transform_array[2]);
-    rotate_board(this->board_0, this->board_270, this->transform_array[3]);
+    // piece type of each slot, in field order
+    const U8 slot_pieces[n_pieces] = {ROOK, ROOK, KING, BISHOP, KNIGHT, KNIGHT, PAWN, PAWN, PAWN, PAWN};
+
+    for (int c=0; c<2; c++) {
+        U8 color = c ? BLACK : WHITE;
+        const U8 *pieces = this->pieces_of(color);
+        for (int i=0; i<n_pieces; i++) {
+            if (pieces[i] != DEAD) this->board_0[pieces[i]] = color | slot_pieces[i];
+        }
+    }
+
+    this->set_square_slots();
+    this->set_bitboards();
+    this->set_hash();
 }
 
-void BoardData::set_7x7_transforms() {
-    this->transform_array[0]         = (U8*)id_7x7;
-    this->transform_array[1]         = (U8*)cw_90_7x7;
-    this->transform_array[2]         = (U8*)cw_180_7x7;
-    this->transform_array[3]         = (U8*)acw_90_7x7;
-    this->inverse_transform_array[0] = (U8*)id_7x7;
-    this->inverse_transform_array[1] = (U8*)acw_90_7x7;
-    this->inverse_transform_array[2] = (U8*)cw_180_7x7;
-    this->inverse_transform_array[3] = (U8*)cw_90_7x7;
+void BoardData::set_square_slots() {
+
+    memset(this->square_slot, DEAD, 64);
+
+    const U8 *pieces = this->pieces_of(WHITE);
+    for (int i=0; i<2*n_pieces; i++) {
+        if (pieces[i] != DEAD) this->square_slot[pieces[i]] = i;
+    }
 }
 
-void BoardData::set_8x8_transforms() {
-    this->transform_array[0]         = (U8*)id_8x8;
-    this->transform_array[1]         = (U8*)cw_90_8x8;
-    this->transform_array[2]         = (U8*)cw_180_8x8;
-    this->transform_array[3]         = (U8*)acw_90_8x8;
-    this->inverse_transform_array[0] = (U8*)id_8x8;
-    this->inverse_transform_array[1] = (U8*)acw_90_8x8;
-    this->inverse_transform_array[2] = (U8*)cw_180_8x8;
-    this->inverse_transform_array[3] = (U8*)cw_90_8x8;
+void BoardData::set_bitboards() {
+
+    memset(this->color_bb, 0, sizeof(this->color_bb));
+    memset(this->piece_bb, 0, sizeof(this->piece_bb));
+
+    for (int i=0; i<64; i++) {
+        U8 piece = this->board_0[i];
+        if (!(piece & (WHITE | BLACK))) continue;
+        this->color_bb[coloridx(piece)] |= sqbit(i);
+        this->piece_bb[pieceidx(piece)] |= sqbit(i);
+    }
+}
+
+void BoardData::set_hash() {
+
+    this->hash = zobrist_keys.board_type[this->board_type];
+    if (this->player_to_play == BLACK) this->hash ^= zobrist_keys.black_to_play;
+
+    for (int i=0; i<64; i++) {
+        U8 piece = this->board_0[i];
+        if (!(piece & (WHITE | BLACK))) continue;
+        this->hash ^= zobrist_keys.piece[zobrist_piece(piece)][i];
+    }
 }
 
 void BoardData::set_7_3_layout() {
@@ -76,10 +80,6 @@ void BoardData::set_7_3_layout() {
     this->w_bishop = pos(3,0);
     this->w_pawn_1 = pos(2,1);
     this->w_pawn_2 = pos(2,0);
-
-    this->pawn_promo_squares[0] = pos(2,0);
-    this->pawn_promo_squares[1] = pos(2,1);
-    this->n_pawn_promo_squares = 2;
 }
 
 void BoardData::set_8_4_layout() {
@@ -100,10 +100,6 @@ void BoardData::set_8_4_layout() {
     this->b_rook_2 = pos(3,7);
     this->b_pawn_3 = pos(5,6);
     this->b_pawn_4 = pos(5,7);
-
-    this->pawn_promo_squares[0] = pos(2,0);
-    this->pawn_promo_squares[1] = pos(2,1);
-    this->n_pawn_promo_squares = 2;
 }
 
 void BoardData::set_8_2_layout() {
@@ -128,37 +124,22 @@ void BoardData::set_8_2_layout() {
     this->b_bishop   = pos(3,5);
     this->b_rook_1   = pos(2,6);
     this->b_rook_2   = pos(2,7);
-
-    this->pawn_promo_squares[0] = pos(2,0);
-    this->pawn_promo_squares[1] = pos(2,1);
-    this->pawn_promo_squares[2] = pos(2,2);
-    this->n_pawn_promo_squares = 3;
 }
 
-BoardData::BoardData(BoardType btype): 
-    board_0{0}, 
-    board_90{0}, 
-    board_180{0}, 
-    board_270{0}, 
-    pawn_promo_squares{0} {
+BoardData::BoardData(BoardType btype):
+    board_0{0} {
 
     this->board_type = btype;
+    this->valid_squares = board_geometry[btype].valid;
 
     if (btype == SEVEN_THREE) {
         this->set_7_3_layout();
-        this->set_7x7_transforms();
-        this->board_mask = (U8*)board_7_3;
+    }
+    else if (btype == EIGHT_FOUR) {
+        this->set_8_4_layout();
     }
     else {
-        this->set_8x8_transforms();
-        if (btype == EIGHT_FOUR) {
-            this->set_8_4_layout();
-            this->board_mask = (U8*)board_8_4;
-        }
-        else {
-            this->set_8_2_layout();
-            this->board_mask = (U8*)board_8_2;
-        }
+        this->set_8_2_layout();
     }
 
     this->set_pieces_on_board();
@@ -166,44 +147,48 @@ BoardData::BoardData(BoardType btype):
 
 BoardData::BoardData() {}
 
-BoardData::BoardData(const BoardData& source) {
-
-    this->b_rook_1   = source.b_rook_1   ;
-    this->b_rook_2   = source.b_rook_2   ;
-    this->b_king     = source.b_king     ;
-    this->b_bishop   = source.b_bishop   ;
-    this->b_knight_1 = source.b_knight_1 ;
-    this->b_knight_2 = source.b_knight_2 ;
-    this->b_pawn_1   = source.b_pawn_1   ;
-    this->b_pawn_2   = source.b_pawn_2   ;
-    this->b_pawn_3   = source.b_pawn_3   ;
-    this->b_pawn_4   = source.b_pawn_4   ;
-                                         ;
-    this->w_rook_1   = source.w_rook_1   ;
-    this->w_rook_2   = source.w_rook_2   ;
-    this->w_king     = source.w_king     ;
-    this->w_bishop   = source.w_bishop   ;
-    this->w_knight_1 = source.w_knight_1 ;
-    this->w_knight_2 = source.w_knight_2 ;
-    this->w_pawn_1   = source.w_pawn_1   ;
-    this->w_pawn_2   = source.w_pawn_2   ;
-    this->w_pawn_3   = source.w_pawn_3   ;
-    this->w_pawn_4   = source.w_pawn_4   ;
-
-    memcpy(this->board_0  , source.board_0  , 64);
-    memcpy(this->board_90 , source.board_90 , 64);
-    memcpy(this->board_180, source.board_180, 64);
-    memcpy(this->board_270, source.board_270, 64);
-
-    this->board_type = source.board_type;
-    this->board_mask = source.board_mask;
-    this->player_to_play = source.player_to_play;
-    this->last_killed_piece = source.last_killed_piece;
-    this->last_killed_piece_idx = source.last_killed_piece_idx;
-
-    memcpy(this->transform_array, source.transform_array, 4*sizeof(U8*));
-    memcpy(this->inverse_transform_array, source.inverse_transform_array, 4*sizeof(U8*));
-
-    memcpy(this->pawn_promo_squares, source.pawn_promo_squares, 10);
-    this->n_pawn_promo_squares = source.n_pawn_promo_squares;
+PackedBoardData BoardData::pack() const {
+
+    PackedBoardData packed;
+    memcpy(packed.pieces, this->pieces_of(WHITE), 2*n_pieces);
+    packed.promo_rook = 0;
+    packed.promo_bishop = 0;
+
+    for (int c=0; c<2; c++) {
+        const U8 *pawns = this->pieces_of(c ? BLACK : WHITE) + first_pawn_slot;
+        for (int i=0; i<n_pieces-first_pawn_slot; i++) {
+            if (pawns[i] == DEAD) continue;
+            U8 bit = 1 << (c*(n_pieces-first_pawn_slot) + i);
+            if (this->board_0[pawns[i]] & ROOK)   packed.promo_rook   |= bit;
+            if (this->board_0[pawns[i]] & BISHOP) packed.promo_bishop |= bit;
+        }
+    }
+
+    packed.flags = (this->player_to_play == BLACK) | (this->board_type << 1);
+    return packed;
+}
+
+BoardData BoardData::unpack(const PackedBoardData &packed) {
+
+    BoardData data((BoardType)(packed.flags >> 1));
+    memset(data.board_0, 0, 64);
+    memcpy(data.pieces_of(WHITE), packed.pieces, 2*n_pieces);
+    data.player_to_play = (packed.flags & 1) ? BLACK : WHITE;
+    data.set_pieces_on_board();
+
+    for (int c=0; c<2; c++) {
+        U8 color = c ? BLACK : WHITE;
+        const U8 *pawns = data.pieces_of(color) + first_pawn_slot;
+        for (int i=0; i<n_pieces-first_pawn_slot; i++) {
+            U8 bit = 1 << (c*(n_pieces-first_pawn_slot) + i);
+            if (packed.promo_rook & bit)   data.board_0[pawns[i]] = color | ROOK;
+            if (packed.promo_bishop & bit) data.board_0[pawns[i]] = color | BISHOP;
+        }
+    }
+
+    if (packed.promo_rook | packed.promo_bishop) {
+        data.set_bitboards();
+        data.set_hash();
+    }
+    return data;
 }
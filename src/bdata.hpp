@@ -3,6 +3,8 @@
 #include <vector>
 #include <unordered_set>
 #include <stack>
+#include <cstddef>
+#include <type_traits>
 #include "constants.hpp"
 
 /**
@@ -43,15 +45,48 @@ enum BoardType {
     EIGHT_TWO = 3 
 };
 
+/**
+ * Writes the board src into tgt rotated by the given transformation array,
+ * i.e. tgt[transform[i]] = src[i].
+ */
+void rotate_board(const U8 *src, U8 *tgt, const U8 *transform);
+
+/**
+ * The PackedBoardData struct is a compact, pointer-free form of a position,
+ * for storing positions in books, datasets and caches. It holds the piece
+ * slots in BoardData field order, which pawn slots hold a promoted piece, the
+ * player to play and the board type; everything else is rebuilt on unpack.
+ */
+struct PackedBoardData {
+
+  // Squares of the 20 piece slots in BoardData field order, DEAD if captured.
+  U8 pieces[20];
+
+  // Bit i set if pawn slot i (0-3 white pawns 1-4, 4-7 black pawns 1-4) holds
+  // a pawn promoted to a rook / bishop.
+  U8 promo_rook;
+  U8 promo_bishop;
+
+  // Bit 0 set if black is to play, bits 1-2 hold the BoardType.
+  U8 flags;
+};
+
+static_assert(sizeof(PackedBoardData) <= 32, "PackedBoardData must fit in 32 bytes");
+
 /**
  * The BoardData struct serves as an object-based representation of the current
  * board state and configuration. Provides member functions and instances that
  * will serve to represent the game's current status and progress.
+ *
+ * BoardData holds no pointers: the board mask, transforms and move tables of
+ * its board type are looked up through board_type (see bgeom.hpp). It is
+ * trivially copyable and cache-line aligned, so copying a position is a plain
+ * block copy.
  */
-struct BoardData {
+struct alignas(64) BoardData {
 
   // Declare variables that hold position of each piece. Default to DEAD.
-  // DO NOT add any fields above this
+  // The 20 fields are contiguous and in this order, see pieces_of.
   U8 w_rook_1 = DEAD;
   U8 w_rook_2 = DEAD;
   U8 w_king = DEAD;
@@ -74,28 +109,46 @@ struct BoardData {
   U8 b_pawn_3 = DEAD;
   U8 b_pawn_4 = DEAD;
 
-  static const int n_pieces = 10;
+  static const int n_pieces = 10;       /* Piece slots per colour. */
+  static const int first_pawn_slot = 6; /* Pawns are the last four slots. */
+
+  // Slot (index into the piece fields above, 0-19) of the piece on each
+  // square, DEAD if the square is empty. Updated on make/unmake.
+  U8 square_slot[64];
 
-  // Array that holds the board state from different orientations.
+  // Array that holds the board state. Rotated views for debugging can be
+  // built with rotate_board; move generation uses the ray tables instead.
   U8 board_0[64];
-  U8 board_90[64];
-  U8 board_180[64];
-  U8 board_270[64];
+
+  // Bitboards kept in sync with board_0. Colour occupancy is indexed by
+  // coloridx(color), piece occupancy by pieceidx(piece type).
+  U64 color_bb[2] = {0, 0};
+  U64 piece_bb[5] = {0, 0, 0, 0, 0};
+  U64 valid_squares = 0;
+
+  // Zobrist key of the position: pieces on squares, side to play and board
+  // type. Updated incrementally by make/unmake and flip_player_.
+  U64 hash = 0;
 
   // Variables that record the game status and configuration.
   BoardType board_type = SEVEN_THREE;
-  U8 *board_mask;
   PlayerColor player_to_play = WHITE;
-  U8 last_killed_piece = 0;
-  int last_killed_piece_idx = -1;
 
-  // Transformation arrays for 90, 180, and 270 degree rotations of the matrix.
-  U8 *transform_array[4];
-  U8 *inverse_transform_array[4];
+  /**
+   * Returns the piece (colour | type) on a square, 0 if it is empty.
+   */
+  U8 piece_at(U8 square) const { return board_0[square]; }
+
+  /**
+   * Returns the slot (0-19) of the piece on a square, DEAD if it is empty.
+   */
+  U8 slot_at(U8 square) const { return square_slot[square]; }
 
-  // Variables that represent pawn promotion squares
-  U8 pawn_promo_squares[10];
-  int n_pawn_promo_squares;
+  /**
+   * Returns the n_pieces slots of a colour, in field order.
+   */
+  const U8 *pieces_of(U8 color) const { return &w_rook_1 + coloridx(color) * n_pieces; }
+  U8 *pieces_of(U8 color) { return &w_rook_1 + coloridx(color) * n_pieces; }
 
   /**
    * Default constructor - initializes an instance of the BoardData structure.
@@ -110,10 +163,17 @@ struct BoardData {
   BoardData(BoardType board_type);
 
   /**
-   * Copy constructor - creates a deep copy of the source instance.
-   * @param source - source BoardData instance from which to copy.
+   * member function that packs the position into its compact form.
+   * @return the packed position; BoardData::unpack restores it exactly.
    */
-  BoardData(const BoardData &source);
+  PackedBoardData pack() const;
+
+  /**
+   * Rebuilds a position from its packed form.
+   * @param packed - a position returned by pack().
+   * @return the unpacked position, with board, bitboards and hash set.
+   */
+  static BoardData unpack(const PackedBoardData &packed);
 
   /**
    * member function that sets pieces on the board based on their status(dead or
@@ -122,31 +182,37 @@ struct BoardData {
   void set_pieces_on_board();
 
   /**
-   * member function that sets the board layout for 8x4.
+   * member function that rebuilds square_slot from the piece fields.
    */
-  void set_8_4_layout();
+  void set_square_slots();
 
   /**
-   * member function that sets the board layout for 8x2.
+   * member function that rebuilds the colour and piece bitboards from board_0.
    */
-  void set_8_2_layout();
+  void set_bitboards();
 
   /**
-   * member function that sets the board layout for 7x3.
+   * member function that recomputes the Zobrist key from scratch, starting
+   * from the key of the board type.
    */
-  void set_7_3_layout();
+  void set_hash();
 
   /**
-   * member function that implements 7x7 transforms.
-   * Sets the transformation and inverse transformation arrays to represent 7x7
-   * board rotation.
+   * member function that sets the board layout for 8x4.
+   */
+  void set_8_4_layout();
+
+  /**
+   * member function that sets the board layout for 8x2.
    */
-  void set_7x7_transforms();
+  void set_8_2_layout();
 
   /**
-   * member function that implements 8x8 transforms.
-   * Sets the transformation and inverse transformation arrays to represent 8x8
-   * board rotation.
+   * member function that sets the board layout for 7x3.
    */
-  void set_8x8_transforms();
+  void set_7_3_layout();
 };
+
+static_assert(std::is_trivially_copyable<BoardData>::value, "BoardData must be trivially copyable");
+static_assert(offsetof(BoardData, b_pawn_4) - offsetof(BoardData, w_rook_1) == 2*BoardData::n_pieces - 1,
+        "piece fields must be contiguous");
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "bdata.hpp"
+#include "constants.hpp"
+
+/**
+ * Indexes of the sliding pieces in the ray tables of BoardGeometry.
+ */
+enum RayPiece {
+    RAY_ROOK = 0,
+    RAY_BISHOP = 1
+};
+
+/**
+ * The BoardGeometry struct holds the move tables of a board type, computed at
+ * compile time from the board masks and rotation arrays in constants.hpp. All
+ * squares and masks are in board_0 coordinates, so a piece's targets can be
+ * read straight off a table instead of rotating the board and walking it.
+ */
+struct BoardGeometry {
+
+  // Squares that are part of the board (board mask value != 1).
+  U64 valid = 0;
+
+  // Squares a king / knight on a square can step to on an empty board.
+  U64 king_moves[64] = {};
+  U64 knight_moves[64] = {};
+
+  // Squares a pawn on a square can move to, and the reverse relation: the
+  // squares from which a pawn can move onto a square. Pawns of both colours
+  // move the same way round the board.
+  U64 pawn_moves[64] = {};
+  U64 pawn_sources[64] = {};
+
+  // Subset of pawn_moves that promotes, indexed by coloridx of the pawn, and
+  // the union over all squares: where pawns of a colour promote.
+  U64 pawn_promo[2][64] = {};
+  U64 promo_squares[2] = {};
+
+  static const int n_rays = 4;
+  static const int max_ray_squares = 32;
+
+  // The four rays of a rook / bishop on a square, indexed by RayPiece, with
+  // reflections off the outer ring already unrolled. Ray r holds the squares
+  // ray_squares[..][sq][ray_end[..][sq][r-1] .. ray_end[..][sq][r]) in the
+  // order the piece reaches them; rays can be empty.
+  U8 ray_squares[2][64][max_ray_squares] = {};
+  U8 ray_end[2][64][n_rays] = {};
+
+  // Reverse ray tables, indexed by RayPiece. slider_sources[..][t] holds the
+  // squares s from which a slider reaches t along one of its rays, and
+  // between[..][s][t] the squares that must be empty for it to do so.
+  U64 slider_sources[2][64] = {};
+  U64 between[2][64][64] = {};
+
+  // Reflections on the 8_2 board let a bishop reach a few squares along two
+  // rays. The second path of such a pair is kept here; alt_sources[..][t]
+  // marks the squares s that have one.
+  static const int max_alt_paths = 16;
+  struct AltPath {
+    U8 piece = 0, src = 0, tgt = 0;
+    U64 between = 0;
+  };
+  U64 alt_sources[2][64] = {};
+  AltPath alt_paths[max_alt_paths] = {};
+  int n_alt_paths = 0;
+};
+
+constexpr const U8 *geo_board_mask(BoardType btype) {
+    if (btype == SEVEN_THREE) return board_7_3;
+    if (btype == EIGHT_FOUR) return board_8_4;
+    return board_8_2;
+}
+
+/**
+ * Returns the table of constants.hpp (id, cw_90, cw_180 or acw_90, 7x7 or
+ * 8x8) that maps a square of the rotated frame of a board's idx-th quarter
+ * (its mask value - 2) to the square of the board.
+ */
+constexpr const U8 *geo_transform(BoardType btype, int idx) {
+    if (btype == SEVEN_THREE) {
+        const U8 *t[4] = {id_7x7, cw_90_7x7, cw_180_7x7, acw_90_7x7};
+        return t[idx];
+    }
+    const U8 *t[4] = {id_8x8, cw_90_8x8, cw_180_8x8, acw_90_8x8};
+    return t[idx];
+}
+
+/**
+ * Returns the inverse of geo_transform(btype, idx): board square to
+ * rotated-frame square.
+ */
+constexpr const U8 *geo_inverse_transform(BoardType btype, int idx) {
+    if (btype == SEVEN_THREE) {
+        const U8 *t[4] = {id_7x7, acw_90_7x7, cw_180_7x7, cw_90_7x7};
+        return t[idx];
+    }
+    const U8 *t[4] = {id_8x8, acw_90_8x8, cw_180_8x8, cw_90_8x8};
+    return t[idx];
+}
+
+/**
+ * True if sq (in the rotated frame used for move generation) is one of the
+ * pawn promotion squares of the board type. The tables built from it are
+ * BoardGeometry::pawn_promo and BoardGeometry::promo_squares.
+ */
+constexpr bool geo_is_promo_square(BoardType btype, int sq) {
+    return sq == pos(2,0) || sq == pos(2,1) || (btype == EIGHT_TWO && sq == pos(2,2));
+}
+
+/**
+ * Records the rays of a rook on p0. Mirrors the rotated-frame rules: one
+ * square right and down, up the board (one square on the right end), and left
+ * along the row, reflecting up the left edge when starting on the bottom row.
+ */
+constexpr void make_rook_rays(BoardGeometry &g, BoardType btype, int p0) {
+
+    const U8 *bmask = geo_board_mask(btype);
+    int board_idx = bmask[p0] - 2;
+    const U8 *transform = geo_transform(btype, board_idx);
+    int rp0 = geo_inverse_transform(btype, board_idx)[p0];
+    int x = getx(rp0), y = gety(rp0);
+
+    U8 *sq = g.ray_squares[RAY_ROOK][p0];
+    U8 *end = g.ray_end[RAY_ROOK][p0];
+    int n = 0;
+
+    // right - one square
+    if (inboard(bmask, x+1, y)) sq[n++] = transform[pos(x+1, y)];
+    end[0] = n;
+
+    // bottom - one square
+    if (inboard(bmask, x, y-1)) sq[n++] = transform[pos(x, y-1)];
+    end[1] = n;
+
+    // top - one square on the right end, slide otherwise
+    if (inboard(bmask, x, y+1)) {
+        if (x >= 4) sq[n++] = transform[pos(x, y+1)];
+        else for (int s=1; inboard(bmask, x, y+s); s++) sq[n++] = transform[pos(x, y+s)];
+    }
+    end[2] = n;
+
+    // left, reflecting up the left edge from the bottom row
+    for (int s=1; inboard(bmask, x-s, y); s++) sq[n++] = transform[pos(x-s, y)];
+    if (y == 0) {
+        for (int s=1; inboard(bmask, 0, s); s++) sq[n++] = transform[pos(0, s)];
+    }
+    end[3] = n;
+
+    if (n > BoardGeometry::max_ray_squares) throw "ray table overflow";
+}
+
+/**
+ * Records the rays of a bishop on p0. Mirrors the rotated-frame rules: one
+ * square to the top and bottom right, and slides to the top left and bottom
+ * left that reflect off the edge they run into.
+ */
+constexpr void make_bishop_rays(BoardGeometry &g, BoardType btype, int p0) {
+
+    const U8 *bmask = geo_board_mask(btype);
+    int board_idx = bmask[p0] - 2;
+    const U8 *transform = geo_transform(btype, board_idx);
+    int rp0 = geo_inverse_transform(btype, board_idx)[p0];
+    int x = getx(rp0), y = gety(rp0);
+
+    U8 *sq = g.ray_squares[RAY_BISHOP][p0];
+    U8 *end = g.ray_end[RAY_BISHOP][p0];
+    int n = 0;
+
+    // top right - one square
+    if (inboard(bmask, x+1, y+1)) sq[n++] = transform[pos(x+1, y+1)];
+    end[0] = n;
+
+    // bottom right - one square
+    if (inboard(bmask, x+1, y-1)) sq[n++] = transform[pos(x+1, y-1)];
+    end[1] = n;
+
+    // top left, then reflect off the left or top edge
+    int lx = -1, ly = -1;
+    for (int s=1; inboard(bmask, x-s, y+s); s++) {
+        lx = x-s; ly = y+s;
+        sq[n++] = transform[pos(lx, ly)];
+    }
+    if (lx == 0) {
+        for (int s=1; inboard(bmask, lx+s, ly+s); s++) sq[n++] = transform[pos(lx+s, ly+s)];
+    }
+    else if (lx > 0) {
+        for (int s=1; inboard(bmask, lx-s, ly-s); s++) sq[n++] = transform[pos(lx-s, ly-s)];
+    }
+    end[2] = n;
+
+    // bottom left, then reflect off the bottom edge
+    lx = -1; ly = -1;
+    for (int s=1; inboard(bmask, x-s, y-s); s++) {
+        lx = x-s; ly = y-s;
+        sq[n++] = transform[pos(lx, ly)];
+    }
+    if (lx >= 0) {
+        for (int s=1; inboard(bmask, lx-s, ly+s); s++) sq[n++] = transform[pos(lx-s, ly+s)];
+    }
+    end[3] = n;
+
+    if (n > BoardGeometry::max_ray_squares) throw "ray table overflow";
+}
+
+/**
+ * Fills the reverse ray tables of a slider on s from its forward rays.
+ */
+constexpr void make_reverse_rays(BoardGeometry &g, RayPiece piece, int s) {
+
+    const U8 *sq = g.ray_squares[piece][s];
+    const U8 *end = g.ray_end[piece][s];
+
+    int i = 0;
+    for (int r=0; r<BoardGeometry::n_rays; r++) {
+        U64 before = 0;
+        for (; i<end[r]; i++) {
+            int t = sq[i];
+            if (!(g.slider_sources[piece][t] & sqbit(s))) {
+                g.slider_sources[piece][t] |= sqbit(s);
+                g.between[piece][s][t] = before;
+            }
+            else {
+                if (g.n_alt_paths == BoardGeometry::max_alt_paths) throw "alt path overflow";
+                BoardGeometry::AltPath &alt = g.alt_paths[g.n_alt_paths++];
+                alt.piece = piece; alt.src = s; alt.tgt = t; alt.between = before;
+                g.alt_sources[piece][t] |= sqbit(s);
+            }
+            before |= sqbit(t);
+        }
+    }
+}
+
+constexpr BoardGeometry make_geometry(BoardType btype) {
+
+    BoardGeometry g;
+    const U8 *bmask = geo_board_mask(btype);
+
+    const int king_x[8]   = {1, 1,  1, 0,  0, -1, -1, -1};
+    const int king_y[8]   = {1, 0, -1, 1, -1,  1,  0, -1};
+    const int knight_x[8] = {1, 2,  2,  1, -1, -2, -2, -1};
+    const int knight_y[8] = {2, 1, -1, -2, -2, -1,  1,  2};
+
+    for (int p0 = 0; p0 < 64; p0++) {
+        if (bmask[p0] == 1) continue;
+        g.valid |= sqbit(p0);
+
+        for (int i = 0; i < 8; i++) {
+            if (inboard(bmask, getx(p0)+king_x[i], gety(p0)+king_y[i]))
+                g.king_moves[p0] |= sqbit(pos(getx(p0)+king_x[i], gety(p0)+king_y[i]));
+            if (inboard(bmask, getx(p0)+knight_x[i], gety(p0)+knight_y[i]))
+                g.knight_moves[p0] |= sqbit(pos(getx(p0)+knight_x[i], gety(p0)+knight_y[i]));
+        }
+
+        // pawns always move towards lower x in the frame of their region
+        int board_idx = bmask[p0] - 2;
+        const U8 *transform = geo_transform(btype, board_idx);
+        int rp0 = geo_inverse_transform(btype, board_idx)[p0];
+
+        for (int y = gety(rp0)-1; y <= gety(rp0)+1; y++) {
+            if (!inboard(bmask, getx(rp0)-1, y)) continue;
+            int rp1 = pos(getx(rp0)-1, y);
+            U64 p1 = sqbit(transform[rp1]);
+            g.pawn_moves[p0] |= p1;
+            g.pawn_sources[transform[rp1]] |= sqbit(p0);
+            if (geo_is_promo_square(btype, rp1)) {
+                if (board_idx == 2) g.pawn_promo[coloridx(WHITE)][p0] |= p1;
+                if (board_idx == 0) g.pawn_promo[coloridx(BLACK)][p0] |= p1;
+                g.promo_squares[coloridx(WHITE)] |= g.pawn_promo[coloridx(WHITE)][p0];
+                g.promo_squares[coloridx(BLACK)] |= g.pawn_promo[coloridx(BLACK)][p0];
+            }
+        }
+
+        make_rook_rays(g, btype, p0);
+        make_bishop_rays(g, btype, p0);
+        make_reverse_rays(g, RAY_ROOK, p0);
+        make_reverse_rays(g, RAY_BISHOP, p0);
+    }
+
+    return g;
+}
+
+// Geometry tables indexed by BoardType (index 0 is unused).
+inline constexpr BoardGeometry board_geometry[4] = {
+    BoardGeometry(),
+    make_geometry(SEVEN_THREE),
+    make_geometry(EIGHT_FOUR),
+    make_geometry(EIGHT_TWO)
+};
+
+/**
+ * Calls fn<BT>(args...) for the BoardType btype and returns its result. Code
+ * templated on the board type sees its geometry as a compile-time constant;
+ * this is the one place the runtime board type is switched on.
+ */
+#define DISPATCH_BOARD_TYPE(btype, fn, ...)                 \
+    switch (btype) {                                        \
+        case SEVEN_THREE: return fn<SEVEN_THREE>(__VA_ARGS__); \
+        case EIGHT_FOUR:  return fn<EIGHT_FOUR>(__VA_ARGS__);  \
+        default:          return fn<EIGHT_TWO>(__VA_ARGS__);   \
+    }
+
+/**
+ * Returns the squares a rook or bishop on p0 attacks given the occupancy occ:
+ * every square along its rays up to and including the first occupied one.
+ * Squares reached along two different rays appear once.
+ */
+template <BoardType BT, RayPiece piece>
+inline U64 slider_attacks(int p0, U64 occ) {
+
+    constexpr const BoardGeometry &g = board_geometry[BT];
+    const U8 *sq = g.ray_squares[piece][p0];
+    const U8 *end = g.ray_end[piece][p0];
+    U64 attacks = 0;
+
+    int i = 0;
+    for (int r=0; r<BoardGeometry::n_rays; r++) {
+        for (; i<end[r]; i++) {
+            attacks |= sqbit(sq[i]);
+            if (occ & sqbit(sq[i])) break;
+        }
+        i = end[r];
+    }
+
+    return attacks;
+}
+
+/**
+ * True if a rook / bishop on s reaches t given the occupancy occ. t must be in
+ * slider_sources[piece] of s. Only 8_2 has alternative paths to look up.
+ */
+template <BoardType BT, RayPiece piece>
+inline bool slider_reaches(int s, int t, U64 occ) {
+
+    constexpr const BoardGeometry &g = board_geometry[BT];
+    if (!(g.between[piece][s][t] & occ)) return true;
+
+    if constexpr (g.n_alt_paths == 0) {
+        return false;
+    }
+    else {
+        if (!(g.alt_sources[piece][t] & sqbit(s))) return false;
+
+        for (int i=0; i<g.n_alt_paths; i++) {
+            const BoardGeometry::AltPath &alt = g.alt_paths[i];
+            if (alt.piece == piece && alt.src == s && alt.tgt == t) return !(alt.between & occ);
+        }
+        return false;
+    }
+}
@@ -1,280 +1,289 @@
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "board.hpp"
+#include "bgeom.hpp"
+#include "zobrist.hpp"
+#include "movegen.hpp"
 #include "butils.hpp"
 #include "constants.hpp"
 #include <cstring>
 
-std::unordered_set<U16> transform_moves(const std::unordered_set<U16>& moves, const U8 *transform) {
-
-    std::unordered_set<U16> rot_moves;
-
-    for (U16 move : moves) {
-        rot_moves.insert(move_promo(transform[getp0(move)], transform[getp1(move)], getpromo(move)));
-    }
-
-    return rot_moves;
+std::unordered_set<U16> to_set(const MoveList& moves) {
+    return std::unordered_set<U16>(moves.begin(), moves.end());
 }
 
-std::unordered_set<U16> construct_rook_moves(const U8 p0, const U8 *board, const U8 *bmask) {
+// Move generation and attack detection are templated on the board type so the
+// geometry tables are compile-time constants; the Board methods below pick the
+// instantiation once with DISPATCH_BOARD_TYPE.
 
-    PlayerColor color = color(board[p0]);
-    PlayerColor oppcolor = oppcolor(board[p0]);
-    std::unordered_set<U16> rook_moves;
+template <BoardType BT, typename List>
+void gen_piece_moves(const BoardData &data, U8 piece_pos, List& moves, U64 allowed = ~0ULL) {
 
-    // right - move one square 
-    if (inboard(bmask, getx(p0)+1, gety(p0)) && 
-        !occupied(board, p0+pos(1,0), color)) rook_moves.insert(move(p0, p0+pos(1,0)));
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    U8 piece_id = data.board_0[piece_pos];
+    U64 mask = ~data.color_bb[coloridx(piece_id)] & allowed;
+    U64 occ = data.color_bb[0] | data.color_bb[1];
 
-    // bottom - move one square 
-    if (inboard(bmask, getx(p0), gety(p0)-1) && 
-        !occupied(board, p0-pos(0,1), color)) rook_moves.insert(move(p0, p0-pos(0,1)));
-
-    // top - move multiple if left end (forward), move one if right end
-    if (inboard(bmask, getx(p0), gety(p0)+1)) {
-        if (getx(p0) >= 4 && !occupied(board, p0+pos(0,1), color)) {
-            // right end 
-            rook_moves.insert(move(p0, p0+pos(0,1)));
-        }
-        else {
-            for (int y=1; inboard(bmask, getx(p0), gety(p0)+y); y++) {
-                U8 tgt_pos = p0+pos(0,y);
-                if (occupied(board, tgt_pos, color)) break;
-                
-                rook_moves.insert(move(p0, tgt_pos));
-                if (occupied(board, tgt_pos, oppcolor)) break;
-            }
-        }
+    if (piece_id & PAWN) {
+        construct_pawn_moves(data.board_0, piece_pos, geom.pawn_moves[piece_pos] & mask,
+                geom.pawn_promo[coloridx(piece_id)][piece_pos], moves);
     }
-
-    // left
-    bool blocked = false;
-    for (int x=1; inboard(bmask, getx(p0)-x, gety(p0)); x++) {
-        U8 tgt_pos = p0-pos(x,0);
-        if (occupied(board, tgt_pos, color)) { blocked = true; break; }
-        
-        rook_moves.insert(move(p0, tgt_pos));
-        if (occupied(board, tgt_pos, oppcolor)) { blocked = true; break; }
+    else if (piece_id & ROOK) {
+        construct_moves(data.board_0, piece_pos, slider_attacks<BT, RAY_ROOK>(piece_pos, occ) & mask, moves);
     }
-
-    // reflect if on outer ring and not blocked yet
-    if (!blocked && gety(p0) == 0) {
-        for (int y=1; inboard(bmask, 0, y); y++) {
-            U8 tgt_pos = pos(0,y);
-            if (occupied(board, tgt_pos, color)) break;
-            
-            rook_moves.insert(move(p0, tgt_pos));
-            if (occupied(board, tgt_pos, oppcolor)) break;
-        }
+    else if (piece_id & BISHOP) {
+        construct_moves(data.board_0, piece_pos, slider_attacks<BT, RAY_BISHOP>(piece_pos, occ) & mask, moves);
+    }
+    else if (piece_id & KING) {
+        construct_moves(data.board_0, piece_pos, geom.king_moves[piece_pos] & mask, moves);
+    }
+    else if (piece_id & KNIGHT) {
+        construct_moves(data.board_0, piece_pos, geom.knight_moves[piece_pos] & mask, moves);
     }
-
-    return rook_moves;
 }
 
-std::unordered_set<U16> construct_bishop_moves(const U8 p0, const U8 *board, const U8 *bmask) {
+template <BoardType BT, typename List>
+void gen_side_moves(const BoardData &data, U8 color, List& moves, U64 allowed = ~0ULL) {
+
+    const U8 *pieces = data.pieces_of(color);
+    for (int i=0; i<data.n_pieces; i++) {
+        U8 piece = pieces[i];
+        if (piece == DEAD) continue;
+        gen_piece_moves<BT>(data, piece, moves, allowed);
+    }
+}
 
-    PlayerColor color = color(board[p0]);
-    PlayerColor oppcolor = oppcolor(board[p0]);
-    std::unordered_set<U16> bishop_moves;
+template <BoardType BT>
+bool square_attacked(const BoardData &data, U8 square, U8 by_color) {
+    return square_attacked<BT>(data.piece_bb, square, data.color_bb[coloridx(by_color)],
+            data.color_bb[0] | data.color_bb[1]);
+}
 
-    // top right - move one square 
-    if (inboard(bmask, getx(p0)+1, gety(p0)+1) && 
-        !occupied(board, p0+pos(1,1), color)) bishop_moves.insert(move(p0, p0+pos(1,1)));
+// static exchange evaluation:
+// play the move, then let the sides alternately recapture on its target
+// square with their least valuable attacker, recomputing the attackers
+// against the shrinking occupancy so sliders behind a capturer (x-rays along
+// the reflected rays) join in. Each side may stop capturing when that is
+// better for it; the swap list is then folded back to the first move.
+// Pawns capturing onto a promotion square are counted as promoting to a rook
+// (or to the piece the move itself names); pins are not considered.
+template <BoardType BT>
+int see_move(const BoardData &data, U16 move) {
 
-    // bottom right - move one square 
-    if (inboard(bmask, getx(p0)+1, gety(p0)-1) && 
-        !occupied(board, p0+pos(1,0)-pos(0,1), color)) 
-        bishop_moves.insert(move(p0, p0+pos(1,0)-pos(0,1)));
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    const U8 order[5] = {PAWN, KNIGHT, BISHOP, ROOK, KING};
 
-    // top left - move till reflection, then reflect
-    bool blocked = false;
-    U8 tgt_pos = DEAD;
-    for (int s=1; inboard(bmask, getx(p0)-s, gety(p0)+s); s++) {
-        tgt_pos = p0-pos(s,0)+pos(0,s);
-        if (occupied(board, tgt_pos, color)) { blocked = true; break; }
-        
-        bishop_moves.insert(move(p0, tgt_pos));
-        if (occupied(board, tgt_pos, oppcolor)) { blocked = true; break; }
+    U8 p0 = getp0(move);
+    U8 t = getp1(move);
+    U8 piece = data.board_0[p0];
+    U8 side = (piece & (WHITE | BLACK)) ^ (WHITE | BLACK);
+
+    int gain[32];
+    int d = 0;
+    gain[0] = data.board_0[t] ? piece_value[pieceidx(data.board_0[t])] : 0;
+
+    // value of the piece that now stands on t
+    int on_t = piece_value[pieceidx(piece)];
+    if (getpromo(move)) {
+        int promoted = piece_value[pieceidx(getpromo(move) == PAWN_ROOK ? ROOK : BISHOP)];
+        gain[0] += promoted - on_t;
+        on_t = promoted;
     }
 
-    // reflect on left / top edge
-    if (!blocked) {
-        // std::cout << "Not blocked, reflecting\n";
-        U8 p1 = tgt_pos;
-        if (getx(tgt_pos) == 0) {
-            // left edge 
-            for (int s=1; inboard(bmask, getx(p1)+s, gety(p1)+s); s++) {
-                U8 tgt_pos = p1+pos(s,s);
-                if (occupied(board, tgt_pos, color)) { blocked = true; break; }
-                
-                bishop_moves.insert(move(p0, tgt_pos));
-                if (occupied(board, tgt_pos, oppcolor)) { blocked = true; break; }
+    U64 occ = (data.color_bb[0] | data.color_bb[1]) ^ sqbit(p0);
+    while (d < 31) {
+        U64 attackers = attackers_of<BT>(data.piece_bb, t, data.color_bb[coloridx(side)] & occ, occ);
+        if (!attackers) break;
+
+        U8 from = 0, attacker = 0;
+        for (U8 type : order) {
+            U64 of_type = attackers & data.piece_bb[pieceidx(type)];
+            if (of_type) {
+                from = lsb(of_type);
+                attacker = type;
+                break;
             }
         }
-        else {
-            // top edge
-            for (int s=1; inboard(bmask, getx(p1)-s, gety(p1)-s); s++) {
-                U8 tgt_pos = p1-pos(s,s);
-                if (occupied(board, tgt_pos, color)) { blocked = true; break; }
-                
-                bishop_moves.insert(move(p0, tgt_pos));
-                if (occupied(board, tgt_pos, oppcolor)) { blocked = true; break; }
-            }
-        }
-    }
 
-    // bottom left - move till reflection, then reflect
-    blocked = false;
-    tgt_pos = DEAD;
-    for (int s=1; inboard(bmask, getx(p0)-s, gety(p0)-s); s++) {
-        tgt_pos = p0-pos(s,s);
-        if (occupied(board, tgt_pos, color)) { blocked = true; break; }
-        
-        bishop_moves.insert(move(p0, tgt_pos));
-        if (occupied(board, tgt_pos, oppcolor)) { blocked = true; break; }
-    }
+        // the king may only capture onto a square the other side no longer covers
+        U8 other = side ^ (WHITE | BLACK);
+        if (attacker == KING &&
+                attackers_of<BT>(data.piece_bb, t, data.color_bb[coloridx(other)] & occ & ~sqbit(from), occ ^ sqbit(from))) {
+            break;
+        }
 
-    // reflect on bottom edge
-    if (!blocked) {
-        U8 p1 = tgt_pos;
-        for (int s=1; inboard(bmask, getx(p1)-s, gety(p1)+s); s++) {
-            tgt_pos = p1-pos(s,0)+pos(0,s);
-            if (occupied(board, tgt_pos, color)) { blocked = true; break; }
-            
-            bishop_moves.insert(move(p0, tgt_pos));
-            if (occupied(board, tgt_pos, oppcolor)) { blocked = true; break; }
+        d++;
+        gain[d] = on_t - gain[d-1];
+        on_t = piece_value[pieceidx(attacker)];
+        if (attacker == PAWN && (geom.promo_squares[coloridx(side)] & sqbit(t))) {
+            gain[d] += piece_value[pieceidx(ROOK)] - on_t;
+            on_t = piece_value[pieceidx(ROOK)];
         }
+
+        occ ^= sqbit(from);
+        side = other;
     }
 
-    return bishop_moves;
+    while (d > 0) {
+        gain[d-1] = -std::max(-gain[d-1], gain[d]);
+        d--;
+    }
+    return gain[0];
 }
 
-std::unordered_set<U16> construct_knight_moves(const U8 p0, const U8 *board, const U8 *bmask) {
-
-    PlayerColor color = color(board[p0]);
-    std::unordered_set<U16> knight_moves;
+// legal move generation by make/unmake:
+// Get all pseudolegal moves
+// for each pseudolegal move for our color:
+//     if doing this move will leave the king in threat from opponent's pieces
+//         drop the move from the list
+//     else
+//         keep it, preserving generation order
+template <BoardType BT, typename List>
+void gen_legal_moves_by_make(const BoardData &data, List& moves, U64 targets) {
+
+    Board c(data);
+    U8 color = data.player_to_play;
+    int from = moves.count;
+    gen_side_moves<BT>(c.data, color, moves, targets);
+
+    int n_legal = from;
+    for (int i=from; i<moves.count; i++) {
+        U16 move = getmove(moves.moves[i]);
+        c.do_move_without_flip_(move);
 
-    // similar to king moves
-    int x_incrs[8] = {1, 2,  2,  1, -1, -2, -2, -1};
-    int y_incrs[8] = {2, 1, -1, -2, -2, -1,  1,  2};
+        // a side without a king cannot be in check
+        U8 king_pos = (color == WHITE) ? c.data.w_king : c.data.b_king;
+        if (king_pos == DEAD || !square_attacked<BT>(c.data, king_pos, color ^ (WHITE | BLACK))) {
+            moves.moves[n_legal++] = moves.moves[i];
+        }
 
-    for (int i=0; i<8; i++) {
-        if (!inboard(bmask, getx(p0)+x_incrs[i], gety(p0)+y_incrs[i])) continue;
-        U8 p1 = pos(getx(p0)+x_incrs[i], gety(p0)+y_incrs[i]);
-        if (!occupied(board, p1, color)) knight_moves.insert(move(p0, p1));
+        c.undo_last_move_without_flip_(move);
     }
-
-    return knight_moves;
+    moves.count = n_legal;
 }
 
-bool can_promote(U8 pos, U8 *promo, int n_promo) {
-    for (int i=0; i<n_promo; i++) {
-        if (promo[i] == pos) return true;
+// Masks an enemy slider puts on our pieces: if exactly one of our pieces
+// stands between it and our king, that piece may only move along the line or
+// onto the slider.
+template <BoardType BT, RayPiece piece>
+void restrict_pinned(const BoardData &data, U8 king, U64 sliders, U64 us, U64 occ, U64 *allowed) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    U64 candidates = geom.slider_sources[piece][king] & sliders;
+    while (candidates) {
+        U8 s = pop_lsb(candidates);
+        U64 blockers = geom.between[piece][s][king] & occ;
+        if (popcnt(blockers) != 1 || !(blockers & us)) continue;
+        allowed[data.square_slot[lsb(blockers)] % data.n_pieces] &= geom.between[piece][s][king] | sqbit(s);
     }
-    return false;
-}
-
-std::unordered_set<U16> construct_pawn_moves(const U8 p0, const U8 *board, const U8 *bmask,
-        U8 *promo, int n_promo, bool promote) {
-    
-    PlayerColor color = color(board[p0]);
-    std::unordered_set<U16> pawn_moves;
-
-    for (int y = gety(p0)-1; y <= gety(p0) + 1; y++) {
-        if (!inboard(bmask, getx(p0)-1, y)) continue;
-        U8 p1 = pos(getx(p0)-1, y);
-        if (!occupied(board, p1, color)) {
-            if (promote && can_promote(p1, promo, n_promo)) {
-                pawn_moves.insert(move_promo(p0, p1, PAWN_ROOK));
-                pawn_moves.insert(move_promo(p0, p1, PAWN_BISHOP));
-            }
-            else {
-                pawn_moves.insert(move(p0, p1));
-            }
+}
+
+// legal move generation with check and pin masks:
+// - the king may step to any square that is not attacked once it has left
+//   its own square
+// - in check other pieces must capture the checker or block its ray; in
+//   double check a move must do so for both, which is possible when the
+//   two rays cross (they reflect off the board's edges)
+// - pinned pieces stay on the line between the pinner and the king
+// Positions where an enemy slider has two reflected paths to the king (8_2
+// only) are rare and go through make/unmake instead. Only moves onto targets
+// are generated.
+template <BoardType BT, typename List>
+void gen_legal_moves(const BoardData &data, List& moves, U64 targets) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+    U8 color = data.player_to_play;
+    U8 king = (color == WHITE) ? data.w_king : data.b_king;
+    if (king == DEAD) return gen_legal_moves_by_make<BT>(data, moves, targets);
+
+    U64 us = data.color_bb[coloridx(color)];
+    U64 them = data.color_bb[coloridx(color ^ (WHITE | BLACK))];
+    U64 occ = us | them;
+    U64 rooks = them & data.piece_bb[pieceidx(ROOK)];
+    U64 bishops = them & data.piece_bb[pieceidx(BISHOP)];
+
+    if constexpr (geom.n_alt_paths > 0) {
+        if ((geom.alt_sources[RAY_ROOK][king] & rooks) | (geom.alt_sources[RAY_BISHOP][king] & bishops)) {
+            return gen_legal_moves_by_make<BT>(data, moves, targets);
         }
     }
 
-    return pawn_moves;
-}
+    U64 check_mask = ~0ULL;
+    U64 checkers = attackers_of<BT>(data.piece_bb, king, them, occ);
+    while (checkers) {
+        U8 c = pop_lsb(checkers);
+        U64 mask = sqbit(c);
+        if (data.board_0[c] & ROOK) mask |= geom.between[RAY_ROOK][c][king];
+        if (data.board_0[c] & BISHOP) mask |= geom.between[RAY_BISHOP][c][king];
+        check_mask &= mask;
+    }
 
-std::unordered_set<U16> construct_king_moves(const U8 p0, const U8 *board, const U8 *bmask) {
+    U64 allowed[BoardData::n_pieces];
+    for (int i=0; i<data.n_pieces; i++) allowed[i] = check_mask & targets;
+    restrict_pinned<BT, RAY_ROOK>(data, king, rooks, us, occ, allowed);
+    restrict_pinned<BT, RAY_BISHOP>(data, king, bishops, us, occ, allowed);
 
-    PlayerColor color = color(board[p0]);
-    std::unordered_set<U16> king_moves;
+    const U8 *pieces = data.pieces_of(color);
+    for (int i=0; i<data.n_pieces; i++) {
+        U8 piece = pieces[i];
+        if (piece == DEAD) continue;
 
-    int x_incrs[8] = {1, 1,  1, 0,  0, -1, -1, -1};
-    int y_incrs[8] = {1, 0, -1, 1, -1,  1,  0, -1};
+        if (piece != king) {
+            if (allowed[i]) gen_piece_moves<BT>(data, piece, moves, allowed[i]);
+            continue;
+        }
 
-    for (int i=0; i<8; i++) {
-        if (!inboard(bmask, getx(p0)+x_incrs[i], gety(p0)+y_incrs[i])) continue;
-        U8 p1 = pos(getx(p0)+x_incrs[i], gety(p0)+y_incrs[i]);
-        if (!occupied(board, p1, color)) king_moves.insert(move(p0, p1));
+        U64 king_targets = geom.king_moves[king] & ~us & targets;
+        U64 occ_without_king = occ ^ sqbit(king);
+        while (king_targets) {
+            U8 t = pop_lsb(king_targets);
+            if (!square_attacked<BT>(data.piece_bb, t, them & ~sqbit(t), occ_without_king | sqbit(t))) {
+                push_move(moves, data.board_0, move(king, t));
+            }
+        }
     }
+}
 
-    return king_moves;
+void Board::get_pseudolegal_moves_for_piece(U8 piece_pos, MoveList& moves) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, gen_piece_moves, this->data, piece_pos, moves);
 }
 
 std::unordered_set<U16> Board::get_pseudolegal_moves_for_piece(U8 piece_pos) const {
-
-    std::unordered_set<U16> moves;
-    U8 piece_id = this->data.board_0[piece_pos];
-    int board_idx = data.board_mask[piece_pos] - 2;
-    const U8 *transform_arr = this->data.transform_array[board_idx];
-    const U8 *inv_transform_arr = this->data.inverse_transform_array[board_idx];
-
-    const U8 *board = this->data.board_0;
-    if (board_idx == 1) board = this->data.board_270;
-    if (board_idx == 2) board = this->data.board_180;
-    if (board_idx == 3) board = this->data.board_90;
-
-    if (piece_id & PAWN) {
-        moves = construct_pawn_moves(inv_transform_arr[piece_pos], board, this->data.board_mask,
-                (U8*)this->data.pawn_promo_squares, this->data.n_pawn_promo_squares,
-                (board_idx==2 && (piece_id & WHITE)) || (board_idx==0 && (piece_id & BLACK)));
-    }
-    else if (piece_id & ROOK) {
-        moves = construct_rook_moves(inv_transform_arr[piece_pos], board, this->data.board_mask);
-    }
-    else if (piece_id & BISHOP) {
-        moves = construct_bishop_moves(inv_transform_arr[piece_pos], board, this->data.board_mask);
-    }
-    else if (piece_id & KING) {
-        moves = construct_king_moves(inv_transform_arr[piece_pos], board, this->data.board_mask);
-    }
-    else if (piece_id & KNIGHT) {
-        moves = construct_knight_moves(inv_transform_arr[piece_pos], board, this->data.board_mask);
-    }
-
-    moves = transform_moves(moves, transform_arr);
-    return moves;
+    MoveList moves;
+    this->get_pseudolegal_moves_for_piece(piece_pos, moves);
+    return to_set(moves);
 }
 
 Board::Board(): data{SEVEN_THREE} {}
 
 Board::Board(BoardType btype): data{btype} {}
 
-Board::Board(BoardData bdata) {
+Board::Board(const BoardData& bdata) {
     this->data = bdata; // copy constructor
 }
 
 Board::Board(const Board& source) {
     this->data = source.data; // copy constructor
+    this->undo_count = source.undo_count;
+    memcpy(this->undo_stack, source.undo_stack,
+            std::min(source.undo_count, max_undo) * sizeof(UndoInfo));
 }
 
-bool Board::under_threat(U8 piece_pos) const {
-
-    auto pseudolegal_moves = this->get_pseudolegal_moves_for_side(this->data.player_to_play ^ (WHITE | BLACK));
+Board& Board::operator=(const Board& source) {
+    this->data = source.data;
+    this->undo_count = source.undo_count;
+    memcpy(this->undo_stack, source.undo_stack,
+            std::min(source.undo_count, max_undo) * sizeof(UndoInfo));
+    return *this;
+}
 
-    for (auto move : pseudolegal_moves) {
-        // std::cout << move_to_str(move) << " ";
-        if (getp1(move) == piece_pos) {
-            // std::cout << "<- causes check\n";
-            return true;
-        }
-    }
-    // std::cout << std::endl;
+bool Board::is_square_attacked(U8 square, U8 by_color) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, square_attacked, this->data, square, by_color);
+}
 
-    return false;
+bool Board::under_threat(U8 piece_pos) const {
+    return is_square_attacked(piece_pos, this->data.player_to_play ^ (WHITE | BLACK));
 }
 
 bool Board::in_check() const {
@@ -284,57 +293,61 @@ bool Board::in_check() const {
         king_pos = this->data.b_king;
     }
 
-    return under_threat(king_pos);
+    return king_pos != DEAD && under_threat(king_pos);
+}
+
+void Board::get_pseudolegal_moves(MoveList& moves) const {
+    get_pseudolegal_moves_for_side(this->data.player_to_play, moves);
 }
 
 std::unordered_set<U16> Board::get_pseudolegal_moves() const {
     return get_pseudolegal_moves_for_side(this->data.player_to_play);
 }
 
-std::unordered_set<U16> Board::get_pseudolegal_moves_for_side(U8 color) const {
+void Board::get_pseudolegal_moves_for_side(U8 color, MoveList& moves) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, gen_side_moves, this->data, color, moves);
+}
 
-    std::unordered_set<U16> pseudolegal_moves;
+std::unordered_set<U16> Board::get_pseudolegal_moves_for_side(U8 color) const {
+    MoveList moves;
+    this->get_pseudolegal_moves_for_side(color, moves);
+    return to_set(moves);
+}
 
-    int si = (color>>7) * 10;
+void Board::get_legal_moves(MoveList& moves) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, gen_legal_moves, this->data, moves, ~0ULL);
+}
 
-    U8 *pieces = (U8*)(&this->data);
-    for (int i=0; i<this->data.n_pieces; i++) {
-        U8 piece = pieces[si+i];
-        if (piece == DEAD) continue;
-        auto piece_moves = this->get_pseudolegal_moves_for_piece(piece);
-        pseudolegal_moves.insert(piece_moves.begin(), piece_moves.end());
-    }
+void Board::get_legal_moves(MoveList& moves, U64 targets) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, gen_legal_moves, this->data, moves, targets);
+}
 
-    return pseudolegal_moves;
+void Board::get_legal_moves(ExtMoveList& moves) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, gen_legal_moves, this->data, moves, ~0ULL);
 }
 
-// legal move generation:
-// Get all pseudolegal moves
-// for each pseudolegal move for our color:
-//     if doing this move will leave the king in threat from opponent's pieces
-//         don't add the move to legal moves
-//     else
-//         add to legal moves
-std::unordered_set<U16> Board::get_legal_moves() const {
+void Board::get_legal_moves(ExtMoveList& moves, U64 targets) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, gen_legal_moves, this->data, moves, targets);
+}
 
-    Board c(*this);
-    auto pseudolegal_moves = c.get_pseudolegal_moves();
-    std::unordered_set<U16> legal_moves;
+int Board::see(U16 move) const {
+    DISPATCH_BOARD_TYPE(this->data.board_type, see_move, this->data, move);
+}
 
-    for (auto move : pseudolegal_moves) {
-        c.do_move_without_flip_(move);
+bool Board::is_legal_move(U16 move) const {
 
-        if (!c.in_check()) {
-            legal_moves.insert(move);
-        }
-        else {
-            // std::cout << "Move " << move_to_str(move) << " is illegal" << std::endl;
-        }
+    U8 p0 = getp0(move);
+    if (!(this->data.color_bb[coloridx(this->data.player_to_play)] & sqbit(p0))) return false;
 
-        c.undo_last_move_without_flip_(move);
-    }
+    MoveList moves;
+    this->get_legal_moves(moves, sqbit(getp1(move)));
+    return std::find(moves.begin(), moves.end(), move) != moves.end();
+}
 
-    return legal_moves;
+std::unordered_set<U16> Board::get_legal_moves() const {
+    MoveList moves;
+    this->get_legal_moves(moves);
+    return to_set(moves);
 }
 
 void Board::do_move_(U16 move) {
@@ -344,6 +357,12 @@ void Board::do_move_(U16 move) {
 
 void Board::flip_player_() {
     this->data.player_to_play = (PlayerColor)(this->data.player_to_play ^ (WHITE | BLACK));
+    this->data.hash ^= zobrist_keys.black_to_play;
+}
+
+void Board::undo_move_(U16 move) {
+    flip_player_();
+    undo_last_move_without_flip_(move);
 }
 
 void Board::do_move_without_flip_(U16 move) {
@@ -353,20 +372,33 @@ void Board::do_move_without_flip_(U16 move) {
     U8 promo = getpromo(move);
 
     U8 piecetype = this->data.board_0[p0];
-    this->data.last_killed_piece = 0;
-    this->data.last_killed_piece_idx = -1;
-
-    // scan and get piece from coord
-    U8 *pieces = (U8*)this;
-    for (int i=0; i<2*this->data.n_pieces; i++) {
-        if (pieces[i] == p1) {
-            pieces[i] = DEAD;
-            this->data.last_killed_piece = this->data.board_0[p1];
-            this->data.last_killed_piece_idx = i;
-        }
-        if (pieces[i] == p0) {
-            pieces[i] = p1;
-        }
+    U8 killed = this->data.board_0[p1];
+
+    UndoInfo &undo = this->undo_stack[(this->undo_count++) & (max_undo - 1)];
+    undo.captured_piece = killed;
+    undo.captured_slot = -1;
+    undo.promo = promo;
+    undo.hash = this->data.hash;
+
+    // move the piece's slot, and kill the captured one
+    U8 *pieces = this->data.pieces_of(WHITE);
+    U8 slot = this->data.square_slot[p0];
+    if (killed) {
+        U8 killed_slot = this->data.square_slot[p1];
+        pieces[killed_slot] = DEAD;
+        undo.captured_slot = killed_slot;
+    }
+    pieces[slot] = p1;
+    this->data.square_slot[p1] = slot;
+    this->data.square_slot[p0] = DEAD;
+
+    this->data.color_bb[coloridx(piecetype)] ^= sqbit(p0) | sqbit(p1);
+    this->data.piece_bb[pieceidx(piecetype)] ^= sqbit(p0);
+    this->data.hash ^= zobrist_keys.piece[zobrist_piece(piecetype)][p0];
+    if (killed) {
+        this->data.color_bb[coloridx(killed)] ^= sqbit(p1);
+        this->data.piece_bb[pieceidx(killed)] ^= sqbit(p1);
+        this->data.hash ^= zobrist_keys.piece[zobrist_piece(killed)][p1];
     }
 
     if (promo == PAWN_ROOK) {
@@ -375,57 +407,46 @@ void Board::do_move_without_flip_(U16 move) {
     else if (promo == PAWN_BISHOP) {
         piecetype = (piecetype & (WHITE | BLACK)) | BISHOP;
     }
+    this->data.piece_bb[pieceidx(piecetype)] ^= sqbit(p1);
+    this->data.hash ^= zobrist_keys.piece[zobrist_piece(piecetype)][p1];
 
-    this->data.board_0  [this->data.transform_array[0][p1]] = piecetype;
-    this->data.board_90 [this->data.transform_array[1][p1]] = piecetype;
-    this->data.board_180[this->data.transform_array[2][p1]] = piecetype;
-    this->data.board_270[this->data.transform_array[3][p1]] = piecetype;
-
-    this->data.board_0  [this->data.transform_array[0][p0]] = 0;
-    this->data.board_90 [this->data.transform_array[1][p0]] = 0;
-    this->data.board_180[this->data.transform_array[2][p0]] = 0;
-    this->data.board_270[this->data.transform_array[3][p0]] = 0;
-
+    this->data.board_0[p1] = piecetype;
+    this->data.board_0[p0] = 0;
 }
 
 void Board::undo_last_move_without_flip_(U16 move) {
 
     U8 p0 = getp0(move);
     U8 p1 = getp1(move);
-    U8 promo = getpromo(move);
 
+    const UndoInfo &undo = this->undo_stack[(--this->undo_count) & (max_undo - 1)];
     U8 piecetype = this->data.board_0[p1];
-    U8 deadpiece = this->data.last_killed_piece;
-    this->data.last_killed_piece = 0;
-
-    // scan and get piece from coord
-    U8 *pieces = (U8*)(&(this->data));
-    for (int i=0; i<2*this->data.n_pieces; i++) {
-        if (pieces[i] == p1) {
-            pieces[i] = p0;
-            break;
-        }
-    }
-    if (this->data.last_killed_piece_idx >= 0) {
-        pieces[this->data.last_killed_piece_idx] = p1;
-        this->data.last_killed_piece_idx = -1;
+    U8 deadpiece = undo.captured_piece;
+
+    // move the piece's slot back, and revive the captured one
+    U8 *pieces = this->data.pieces_of(WHITE);
+    U8 slot = this->data.square_slot[p1];
+    pieces[slot] = p0;
+    this->data.square_slot[p0] = slot;
+    this->data.square_slot[p1] = DEAD;
+    if (undo.captured_slot >= 0) {
+        pieces[undo.captured_slot] = p1;
+        this->data.square_slot[p1] = undo.captured_slot;
     }
 
-    if (promo == PAWN_ROOK) {
-        piecetype = ((piecetype & (WHITE | BLACK)) ^ ROOK) | PAWN;
+    this->data.color_bb[coloridx(piecetype)] ^= sqbit(p0) | sqbit(p1);
+    this->data.piece_bb[pieceidx(piecetype)] ^= sqbit(p1);
+    if (deadpiece) {
+        this->data.color_bb[coloridx(deadpiece)] ^= sqbit(p1);
+        this->data.piece_bb[pieceidx(deadpiece)] ^= sqbit(p1);
     }
-    else if (promo == PAWN_BISHOP) {
-        piecetype = ((piecetype & (WHITE | BLACK)) ^ BISHOP) | PAWN;
-    }
-
-    this->data.board_0  [this->data.transform_array[0][p1]] = deadpiece;
-    this->data.board_90 [this->data.transform_array[1][p1]] = deadpiece;
-    this->data.board_180[this->data.transform_array[2][p1]] = deadpiece;
-    this->data.board_270[this->data.transform_array[3][p1]] = deadpiece;
 
-    this->data.board_0  [this->data.transform_array[0][p0]] = piecetype;
-    this->data.board_90 [this->data.transform_array[1][p0]] = piecetype;
-    this->data.board_180[this->data.transform_array[2][p0]] = piecetype;
-    this->data.board_270[this->data.transform_array[3][p0]] = piecetype;
+    if (undo.promo) {
+        piecetype = (piecetype & (WHITE | BLACK)) | PAWN;
+    }
+    this->data.piece_bb[pieceidx(piecetype)] ^= sqbit(p0);
+    this->data.hash = undo.hash;
 
+    this->data.board_0[p1] = deadpiece;
+    this->data.board_0[p0] = piecetype;
 }
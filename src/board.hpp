@@ -7,6 +7,40 @@
 #include "constants.hpp"
 #include "bdata.hpp"
 
+/**
+ * @brief A fixed-capacity, stack-allocated list of moves.
+ *
+ * Move generators append into a MoveList instead of building hash sets, so
+ * generating moves does not touch the heap. Moves are kept in generation
+ * order, which makes iteration order deterministic.
+ *
+ * MoveList holds plain U16 moves; ExtMoveList holds extended U32 moves (see
+ * xmove in constants.hpp) that also record the moving and captured piece.
+ */
+template <typename T>
+struct BasicMoveList {
+
+  static const int capacity = 256; /* Upper bound on moves from any position. */
+
+  T moves[capacity];
+  int count = 0;
+
+  void push(T move) { moves[count++] = move; }
+  void clear() { count = 0; }
+  int size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  T operator[](int i) const { return moves[i]; }
+
+  T *begin() { return moves; }
+  T *end() { return moves + count; }
+  const T *begin() const { return moves; }
+  const T *end() const { return moves + count; }
+};
+
+typedef BasicMoveList<U16> MoveList;
+typedef BasicMoveList<U32> ExtMoveList;
+
 /**
  * @brief Represents the chess board.
  *
@@ -18,6 +52,24 @@ struct Board {
 
   BoardData data; /* The data representing the state of the chess board. */
 
+  /**
+   * @brief What a move needs to be undone: the captured piece and the slot it
+   * occupied (-1 if none), the promotion and the hash before the move.
+   */
+  struct UndoInfo {
+    U8 captured_piece;
+    int8_t captured_slot;
+    U8 promo;
+    U64 hash;
+  };
+
+  static constexpr int max_undo = 256; /* Plies that can be undone; a power of two. */
+
+  /* Undo records of the moves made on this board, most recent last. Older
+   * records are overwritten once more than max_undo moves are on the stack. */
+  UndoInfo undo_stack[max_undo];
+  int undo_count = 0;
+
   /**
    * @brief Default constructor.
    *
@@ -41,7 +93,7 @@ struct Board {
    *
    * @param bdata The board data to initialize with.
    */
-  Board(BoardData bdata);
+  Board(const BoardData &bdata);
 
   /**
    * @brief Copy constructor.
@@ -52,6 +104,15 @@ struct Board {
    */
   Board(const Board &source);
 
+  /**
+   * @brief Copy assignment.
+   *
+   * Copies the board data and the used part of the undo stack.
+   *
+   * @param source The board object to copy.
+   */
+  Board& operator=(const Board &source);
+
   /**
    * @brief Get the legal moves for the current board state.
    *
@@ -64,6 +125,60 @@ struct Board {
    */
   std::unordered_set<U16> get_legal_moves() const;
 
+  /**
+   * @brief Append the legal moves for the current board state to a list.
+   *
+   * Same moves as get_legal_moves(), in deterministic generation order and
+   * without heap allocation. Pins and checks are resolved up front, so only
+   * legal moves are generated.
+   *
+   * @param moves The list to append the legal moves to.
+   */
+  void get_legal_moves(MoveList &moves) const;
+
+  /**
+   * @brief Append the legal moves that land on one of a set of squares.
+   *
+   * Used to generate captures or quiet moves on their own, e.g. with the
+   * opponent's pieces or the empty squares as targets.
+   *
+   * @param moves The list to append the legal moves to.
+   * @param targets Bitboard of the destination squares to generate moves to.
+   */
+  void get_legal_moves(MoveList &moves, U64 targets) const;
+
+  /**
+   * @brief Append the legal moves, with their moving and captured pieces, to
+   * a list of extended moves.
+   *
+   * Same moves and order as get_legal_moves(MoveList&); filling in the
+   * pieces costs nothing extra, and callers can then order or filter
+   * captures without looking at the board.
+   *
+   * @param moves The list to append the legal moves to.
+   */
+  void get_legal_moves(ExtMoveList &moves) const;
+
+  /**
+   * @brief Append the legal moves that land on one of a set of squares to a
+   * list of extended moves.
+   *
+   * @param moves The list to append the legal moves to.
+   * @param targets Bitboard of the destination squares to generate moves to.
+   */
+  void get_legal_moves(ExtMoveList &moves, U64 targets) const;
+
+  /**
+   * @brief Check if a move is legal in the current board state.
+   *
+   * Cheaper than generating all legal moves; used to validate moves from
+   * other positions, such as hash moves.
+   *
+   * @param move The move to check.
+   * @return True if the move is one of the legal moves.
+   */
+  bool is_legal_move(U16 move) const;
+
   /**
    * @brief Check if the current player is in check.
    *
@@ -85,6 +200,17 @@ struct Board {
    */
   void do_move_(U16 move);
 
+  /**
+   * @brief Undo a move made with do_move_.
+   *
+   * Restores the board state from before the move, including the player to
+   * play. Moves must be undone in the reverse order they were made; any
+   * number of do_move_ / undo_move_ pairs can be nested, up to max_undo.
+   *
+   * @param move The move to be undone.
+   */
+  void undo_move_(U16 move);
+
   /**
    * @brief Get the pseudolegal moves for the current board state.
    *
@@ -97,6 +223,14 @@ struct Board {
    */
   std::unordered_set<U16> get_pseudolegal_moves() const;
 
+  /**
+   * @brief Append the pseudolegal moves for the current board state to a
+   * list.
+   *
+   * @param moves The list to append the pseudolegal moves to.
+   */
+  void get_pseudolegal_moves(MoveList &moves) const;
+
   /**
    * @brief Get the pseudolegal moves for a specific piece on the board.
    *
@@ -109,6 +243,14 @@ struct Board {
    */
   std::unordered_set<U16> get_pseudolegal_moves_for_piece(U8 piece_pos) const;
 
+  /**
+   * @brief Append the pseudolegal moves for a specific piece to a list.
+   *
+   * @param piece_pos The position of the piece on the board.
+   * @param moves The list to append the piece's moves to.
+   */
+  void get_pseudolegal_moves_for_piece(U8 piece_pos, MoveList &moves) const;
+
   /**
    * @brief Flip the current player.
    *
@@ -138,13 +280,41 @@ struct Board {
    */
   bool under_threat(U8 piece_pos) const;
 
+  /**
+   * @brief Check if a square is attacked by the pieces of a given side.
+   *
+   * Probes outward from the square instead of generating the attacker's
+   * moves: king, knight and pawn sources come from the geometry tables, and
+   * rooks and bishops are found on the reverse (reflected) rays of the
+   * square and tested for blockers with a single mask.
+   *
+   * @param square The square to test.
+   * @param by_color The color of the attacking side.
+   * @return True if a piece of by_color attacks the square.
+   */
+  bool is_square_attacked(U8 square, U8 by_color) const;
+
+  /**
+   * @brief Static exchange evaluation of a move.
+   *
+   * Resolves the sequence of captures on the move's target square, each side
+   * recapturing with its least valuable attacker and stopping when that is
+   * better, including sliders that join in along the reflected rays once a
+   * piece in front of them has captured. Nothing is played on the board.
+   *
+   * @param move The move to evaluate, normally a capture.
+   * @return The expected material gain for the side making the move, in
+   * piece_value units; negative for a losing capture.
+   */
+  int see(U16 move) const;
+
   /**
    * @brief Undo the last move on the board without flipping the current
    * player.
    *
    * This method undoes the last move that was performed on the board,
-   * restoring the previous board state. It does not change the current
-   * player.
+   * restoring the previous board state from the top of the undo stack. It
+   * does not change the current player.
    *
    * @param move The move to be undone.
    */
@@ -163,4 +333,14 @@ struct Board {
    * current board state.
    */
   std::unordered_set<U16> get_pseudolegal_moves_for_side(U8 color) const;
+
+  /**
+   * @brief Append the pseudolegal moves for a specific side (color) to a
+   * list.
+   *
+   * @param color The color of the side for which to get the pseudolegal
+   * moves.
+   * @param moves The list to append the side's moves to.
+   */
+  void get_pseudolegal_moves_for_side(U8 color, MoveList &moves) const;
 };
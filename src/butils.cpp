@@ -1,6 +1,8 @@
 #include <string>
 #include <iostream>
+#include <sstream>
 #include "board.hpp"
+#include "bgeom.hpp"
 #include "butils.hpp"
 #include "constants.hpp"
 #include <cstring>
@@ -92,7 +94,10 @@ std::string all_boards_to_str(const Board& b) {
     std::string board_str(256, ' ');
     std::string board_mask = ".......\n.......\n..   ..\n..   ..\n..   ..\n.......\n.......\n";
 
-    const U8 (*boards)[64] = &(b.data.board_0);
+    U8 boards[4][64];
+    for (int r=0; r<4; r++) {
+        rotate_board(b.data.board_0, boards[r], geo_transform(b.data.board_type, r));
+    }
 
     for (int b=0; b<4; b++) {
         for (int i=0; i<56; i++) {
@@ -141,3 +146,113 @@ U16 str_to_move(std::string move) {
 
     return move_promo(pos(x0,y0), pos(x1,y1), promo);
 }
+
+const char *board_type_names[4] = {"", "7_3", "8_4", "8_2"};
+
+std::string position_to_str(const BoardData *b) {
+
+    U64 valid = board_geometry[b->board_type].valid;
+    std::string str = board_type_names[b->board_type];
+    str += ' ';
+
+    for (int y=7; y>=0; y--) {
+        if (!(valid & (0xffULL << (8*y)))) continue;
+        if (str.back() != ' ') str += '/';
+
+        int empty = 0;
+        for (int x=0; x<8; x++) {
+            U8 p = pos(x,y);
+            if (!(valid & sqbit(p))) continue;
+            if (!b->board_0[p]) {
+                empty++;
+                continue;
+            }
+            if (empty) str += '0' + empty;
+            empty = 0;
+            str += piece_to_char(b->board_0[p]);
+        }
+        if (empty) str += '0' + empty;
+    }
+
+    str += (b->player_to_play == WHITE) ? " w" : " b";
+    return str;
+}
+
+bool str_to_position(const std::string &pos, BoardData *b) {
+
+    std::istringstream in(pos);
+    std::string type_str, rows, side, extra;
+    if (!(in >> type_str >> rows >> side) || (in >> extra)) return false;
+
+    int btype = 1;
+    while (btype < 4 && type_str != board_type_names[btype]) btype++;
+    if (btype == 4 || (side != "w" && side != "b")) return false;
+
+    PackedBoardData packed;
+    memset(packed.pieces, DEAD, sizeof(packed.pieces));
+    packed.promo_rook = 0;
+    packed.promo_bishop = 0;
+    packed.flags = (side == "b") | (btype << 1);
+
+    // slots each piece type may take, in order; rooks and bishops overflow
+    // into the pawn slots as promoted pawns
+    const int n = BoardData::n_pieces;
+    const int rook_slots[]   = {0, 1, 6, 7, 8, 9, -1};
+    const int king_slots[]   = {2, -1};
+    const int bishop_slots[] = {3, 6, 7, 8, 9, -1};
+    const int knight_slots[] = {4, 5, -1};
+    const int pawn_slots[]   = {6, 7, 8, 9, -1};
+
+    U64 valid = board_geometry[btype].valid;
+    size_t i = 0;
+    for (int y=7; y>=0; y--) {
+        if (!(valid & (0xffULL << (8*y)))) continue;
+        if (i && (i >= rows.size() || rows[i++] != '/')) return false;
+
+        for (int x=0; x<8; x++) {
+            U8 p = pos(x,y);
+            if (!(valid & sqbit(p))) continue;
+            if (i >= rows.size()) return false;
+
+            char ch = rows[i];
+            if (ch >= '1' && ch <= '8') {
+                // consume one empty square of the run, keeping the rest
+                if (ch == '1') i++;
+                else rows[i]--;
+                continue;
+            }
+            i++;
+
+            U8 color = (ch >= 'A' && ch <= 'Z') ? WHITE : BLACK;
+            char type = ch | ('a' - 'A');
+            const int *slots = nullptr;
+            switch (type) {
+                case 'r': slots = rook_slots; break;
+                case 'k': slots = king_slots; break;
+                case 'b': slots = bishop_slots; break;
+                case 'n': slots = knight_slots; break;
+                case 'p': slots = pawn_slots; break;
+                default: return false;
+            }
+
+            U8 *pieces = packed.pieces + coloridx(color) * n;
+            while (*slots >= 0 && pieces[*slots] != DEAD) slots++;
+            if (*slots < 0) return false;
+            pieces[*slots] = p;
+
+            int pawn = *slots - BoardData::first_pawn_slot;
+            if (pawn >= 0 && type != 'p') {
+                U8 bit = 1 << (coloridx(color) * (n - BoardData::first_pawn_slot) + pawn);
+                if (type == 'r') packed.promo_rook |= bit;
+                else packed.promo_bishop |= bit;
+            }
+        }
+    }
+    if (i != rows.size()) return false;
+
+    // each side needs its king (a second one has no slot to go to)
+    if (packed.pieces[2] == DEAD || packed.pieces[n + 2] == DEAD) return false;
+
+    *b = BoardData::unpack(packed);
+    return true;
+}
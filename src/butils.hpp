@@ -65,3 +65,24 @@ std::string board_to_str(const BoardData *b);
 */
 std::string board_7_3_to_str(const U8 *b);
 
+/**
+ * This function is used to convert a position to its text notation: the board
+ * type, the rows of valid squares from the top separated by '/', and the player
+ * to play, e.g. "7_3 2rbp2/2rkp2/4/4/4/2PKR2/2PBR2 w" for the 7_3 start. Pieces
+ * use piece_to_char, and a digit stands for that many empty squares; the holes
+ * in the middle of the board are skipped.
+ * @param pointer b pointing to the BoardData object to convert.
+ * @return pos which is the text notation of the position.
+ */
+std::string position_to_str(const BoardData *b);
+
+/**
+ * This function is used to parse a position in the notation written by
+ * position_to_str. Extra rooks and bishops are placed in free pawn slots as
+ * promoted pawns. Each side must have exactly one king.
+ * @param pos which is the text notation of a position.
+ * @param pointer b pointing to the BoardData object to fill in.
+ * @return true if pos was a valid position, false otherwise (b is left
+ * unchanged).
+ */
+bool str_to_position(const std::string &pos, BoardData *b);
@@ -4,6 +4,8 @@
 
 typedef uint8_t U8;
 typedef uint16_t U16;
+typedef uint32_t U32;
+typedef uint64_t U64;
 
 #define pos(x,y) (((y)<<3)|(x))
 #define gety(p)  ((p)>>3)
@@ -15,6 +17,15 @@ typedef uint16_t U16;
 #define getpromo(m) ((m)&(PAWN_BISHOP|PAWN_ROOK))
 #define getp1(m)    ((m)&0x3f)
 
+// extended (32 bit) moves: the U16 move in the low half, the moving piece in
+// bits 16-23 and the captured piece (0 if none) in bits 24-31. Truncating to
+// U16 gives back the plain move, so the getters above work on both.
+#define xmove(m, piece, captured) ((U32)(m) | ((U32)(piece) << 16) | ((U32)(captured) << 24))
+#define getmove(xm)     ((U16)((xm) & 0xffff))
+#define getpiece(xm)    (((xm) >> 16) & 0xff)
+#define getcaptured(xm) (((xm) >> 24) & 0xff)
+#define iscapture(xm)   (((xm) >> 24) != 0)
+
 #define DEAD 0xff
 
 #define color(p) ((PlayerColor)(p & (WHITE | BLACK)))
@@ -22,6 +33,19 @@ typedef uint16_t U16;
 #define occupied(b, p, c) (b[(p)] & (c))
 #define inboard(b, x, y) (((x) <= 7) && ((x) >= 0) && ((y) <= 7) && ((y) >= 0) && (b[pos((x),(y))] != 1))
 
+// bitboard helpers: bit pos(x,y) of a U64 stands for square (x,y)
+#define sqbit(p)     (1ULL << (p))
+#define coloridx(c)  ((c) >> 7)
+#define pieceidx(p)  (__builtin_ctz((p) & 0x3e) - 1)
+
+// material values for exchange evaluation and capture ordering, indexed by
+// pieceidx: pawn, rook, king, bishop, knight
+constexpr int piece_value[5] = {100, 500, 10000, 300, 300};
+
+inline int popcnt(U64 b) { return __builtin_popcountll(b); }
+inline int lsb(U64 b)    { return __builtin_ctzll(b); }
+inline int pop_lsb(U64 &b) { int p = __builtin_ctzll(b); b &= b - 1; return p; }
+
 constexpr U8 cw_90_7x7[64] = {
     48, 40, 32, 24, 16, 8,  0,  7,
     49, 41, 33, 25, 17, 9,  1,  15,
@@ -4,6 +4,14 @@
 #include <random>
 #include <iostream>
 #include <climits>
+#include <cmath>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <unordered_map>
 
 using namespace std;
@@ -11,12 +19,51 @@ using namespace std;
 #include "board.hpp"
 #include "engine.hpp"
 #include "butils.hpp"
+#include "movepick.hpp"
 
 int moves_played;
 
 int MIN_SEARCH_DEPTH = 2;
 int MAX_SEARCH_DEPTH = 8;
-int QUIESCENCE_DEPTH = 2;
+
+// quiescence search skips captures that cannot bring the score back to the
+// window even with this much positional gain on top of the material
+const int DELTA_MARGIN = 200;
+
+const size_t TT_SIZE_MB = 64;
+
+// Each iteration first searches a window this wide either side of the
+// previous score, doubling it on every fail; past the maximum, or for won
+// or lost scores, it searches the full window.
+const int ASPIRATION_WINDOW = 50;
+const int ASPIRATION_MAX_WINDOW = 1600;
+const int WIN_SCORE = 50000;
+
+// Bounds of the search window, beyond any evaluation. Nodes with no move
+// to score return INT_MIN / INT_MAX; those are clamped to this before they
+// become alpha or beta, so null windows (alpha, alpha + 1) cannot overflow.
+const int INFINITE_SCORE = 1 << 24;
+
+// null-move pruning: at this depth and above, a side that still has a
+// piece other than king and pawns passes, and the search is cut if the
+// opponent cannot make use of it at depth - 1 - NULL_MOVE_REDUCTION
+const int NULL_MOVE_MIN_DEPTH = 3;
+const int NULL_MOVE_REDUCTION = 2;
+
+// late move reductions: quiet moves after the first LMR_MIN_MOVES, at
+// LMR_MIN_DEPTH and above, are searched LMR_REDUCTIONS[depth][move number]
+// plies shallower first. The table is built per board type from
+// LMR_PARAMS: base + log(depth) * log(move number) / divisor.
+const int LMR_MIN_DEPTH = 3;
+const int LMR_MIN_MOVES = 3;
+const int LMR_TABLE_SIZE = 64;
+const double LMR_PARAMS[4][2] = {
+    {0.0, 1.0},
+    {0.25, 3.0},    // SEVEN_THREE: few moves per position, reduce gently
+    {0.25, 2.75},   // EIGHT_FOUR
+    {0.5, 2.25}     // EIGHT_TWO: knights make the tree widest
+};
+int LMR_REDUCTIONS[LMR_TABLE_SIZE][LMR_TABLE_SIZE];
 
 const int MAX_PIECES = 10;
 
@@ -49,7 +96,6 @@ U8 opponent_promo;
 
 auto start_time = chrono::high_resolution_clock::now();
 
-int nodes_visited;
 int curr_player = -1;
 int point_distance;
 
@@ -57,14 +103,78 @@ int PAWN_DISTANCE[64][64];
 int ROOK_DISTANCE[64][64];
 int KNIGHT_DISTANCE[64][64];
 
-int PLAYER_WEIGHTS[MAX_PIECES] = {ROOK_WEIGHT, ROOK_WEIGHT, KING_WEIGHT, BISHOP_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, KNIGHT_WEIGHT, KNIGHT_WEIGHT};
-int OPPONENT_WEIGHTS[MAX_PIECES] = {ROOK_WEIGHT, ROOK_WEIGHT, KING_WEIGHT, BISHOP_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, KNIGHT_WEIGHT, KNIGHT_WEIGHT};
+// weights per piece slot, in BoardData field order
+const int FIRST_PAWN_SLOT = 6;
+int PLAYER_WEIGHTS[MAX_PIECES] = {ROOK_WEIGHT, ROOK_WEIGHT, KING_WEIGHT, BISHOP_WEIGHT, KNIGHT_WEIGHT, KNIGHT_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT};
+int OPPONENT_WEIGHTS[MAX_PIECES] = {ROOK_WEIGHT, ROOK_WEIGHT, KING_WEIGHT, BISHOP_WEIGHT, KNIGHT_WEIGHT, KNIGHT_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT};
 
 
 unordered_map<U8, int> quadrants;
 U8 quad_points[4];
 
-unordered_map<string, int> previous_board_occurences;
+// Hashes of the positions of the game so far followed by those on the
+// current search path, for repetition detection. Only the entries since the
+// last capture or promotion can repeat, so lookups scan just those.
+struct HashHistory {
+
+    struct Entry {
+        U64 key;
+        int material;    // pieces * 16 + pawns: changes on every irreversible move
+        int reversible;  // entries since the last irreversible move
+    };
+
+    vector<Entry> entries;
+    int path_start = 0;  // first entry that is on the search path
+
+    HashHistory() {
+        entries.reserve(1024);
+    }
+
+    void clear() {
+        entries.clear();
+        path_start = 0;
+    }
+
+    // A null move is pushed as irreversible: positions before it must not
+    // count as repeated after it.
+    void push(const BoardData& data, bool irreversible = false) {
+        int material = 16 * popcnt(data.color_bb[0] | data.color_bb[1]) + popcnt(data.piece_bb[pieceidx(PAWN)]);
+        int reversible = (irreversible || entries.empty() || entries.back().material != material) ? 0 : entries.back().reversible + 1;
+        entries.push_back({data.hash, material, reversible});
+    }
+
+    void pop() {
+        entries.pop_back();
+    }
+
+    // Marks the entries pushed from now on as the search path.
+    void start_path() {
+        path_start = entries.size();
+    }
+
+    // Times key occurs among the game positions that can still repeat.
+    int game_count(U64 key) const {
+        int n = 0;
+        int last = (int)entries.size() - 1;
+        int first = entries.empty() ? 0 : last - entries.back().reversible;
+        for (int i = min(last, path_start - 1); i >= first; i--) {
+            n += (entries[i].key == key);
+        }
+        return n;
+    }
+
+    // True if the last position pushed already occurs on the search path.
+    bool repeats_on_path() const {
+        int last = (int)entries.size() - 1;
+        int first = max(path_start, last - entries.back().reversible);
+        for (int i = last - 1; i >= first; i--) {
+            if (entries[i].key == entries[last].key) return true;
+        }
+        return false;
+    }
+};
+
+HashHistory history;
 
 struct Evaluation {
     int piece_weight    = 0;
@@ -75,7 +185,6 @@ struct Evaluation {
     int attack          = 0;
     // int ring_weight     = 0;
     int total           = 0;
-    vector<U16> moves;
 
     void reset() {
         piece_weight    = 0;
@@ -291,6 +400,16 @@ int get_knight_distance(U8 knight_pos, U8 final_pos) {
     return 10000;
 }
 
+void init_reductions(BoardType board_type) {
+    double base = LMR_PARAMS[board_type][0];
+    double divisor = LMR_PARAMS[board_type][1];
+    for (int depth = 0; depth < LMR_TABLE_SIZE; depth++) {
+        for (int moves = 0; moves < LMR_TABLE_SIZE; moves++) {
+            LMR_REDUCTIONS[depth][moves] = (depth == 0 || moves == 0) ? 0 : (int)(base + log(depth) * log(moves) / divisor);
+        }
+    }
+}
+
 void init_distances(BoardType board_type) {
     int board_length = 8;
     // if (board_type == SEVEN_THREE) {
@@ -310,59 +429,38 @@ void init_distances(BoardType board_type) {
 
 Evaluation eval(Board& b) {
 
-    U8 white_pieces[MAX_PIECES] = {b.data.w_rook_1, b.data.w_rook_2, b.data.w_king, b.data.w_bishop, b.data.w_pawn_1,
-                            b.data.w_pawn_2, b.data.w_pawn_3, b.data.w_pawn_4, b.data.w_knight_1, b.data.w_knight_2};
-    U8 black_pieces[MAX_PIECES] = {b.data.b_rook_1, b.data.b_rook_2, b.data.b_king, b.data.b_bishop, b.data.b_pawn_1,
-                            b.data.b_pawn_2, b.data.b_pawn_3, b.data.b_pawn_4, b.data.b_knight_1, b.data.b_knight_2};
-
-    U8* player_pieces = (curr_player == WHITE ? white_pieces : black_pieces);
-    U8* opponent_pieces = (curr_player == WHITE ? black_pieces : white_pieces);
+    const U8* player_pieces = b.data.pieces_of(curr_player);
+    const U8* opponent_pieces = b.data.pieces_of(curr_player ^ (WHITE | BLACK));
 
     U8 player_king = player_pieces[2];
     U8 opponent_king = opponent_pieces[2];
 
-    unordered_set<U16> player_moves, opponent_moves;
-    (curr_player == b.data.player_to_play ? player_moves : opponent_moves) = b.get_legal_moves();
+    ExtMoveList player_moves, opponent_moves;
+    b.get_legal_moves(curr_player == b.data.player_to_play ? player_moves : opponent_moves);
     b.flip_player_();
-    (curr_player == b.data.player_to_play ? player_moves : opponent_moves) = b.get_legal_moves();
+    b.get_legal_moves(curr_player == b.data.player_to_play ? player_moves : opponent_moves);
     b.flip_player_();
 
     Evaluation score;
 
-    auto calc_victory_score = [&](U8* winner_pieces, U8* loser_pieces) {
-        int victory = 100;
-        for (int i = 0; i < MAX_PIECES; i++) {
-            if (winner_pieces[i] == DEAD) {
-                // eat 5 star, do nothing
-            } else if (b.data.board_0[winner_pieces[i]] & BISHOP) {
-                victory += MARGIN_BISHOP_WEIGHT;
-            } else if (b.data.board_0[winner_pieces[i]] & ROOK) {
-                victory += MARGIN_ROOK_WEIGHT;
-            } else if (b.data.board_0[winner_pieces[i]] & KNIGHT) {
-                victory += MARGIN_KNIGHT_WEIGHT;
-            } else if (b.data.board_0[winner_pieces[i]] & PAWN) {
-                victory += MARGIN_PAWN_WEIGHT;
-            }
-            if (loser_pieces[i] == DEAD) {
-                // eat 5 star, do nothing
-            } else if (b.data.board_0[loser_pieces[i]] & BISHOP) {
-                victory -= MARGIN_BISHOP_WEIGHT;
-            } else if (b.data.board_0[loser_pieces[i]] & ROOK) {
-                victory -= MARGIN_ROOK_WEIGHT;
-            } else if (b.data.board_0[loser_pieces[i]] & KNIGHT) {
-                victory -= MARGIN_KNIGHT_WEIGHT;
-            } else if (b.data.board_0[loser_pieces[i]] & PAWN) {
-                victory -= MARGIN_PAWN_WEIGHT;
-            }
-        }
+    auto calc_margin = [&](U8 color) {
+        U64 pieces = b.data.color_bb[coloridx(color)];
+        return MARGIN_BISHOP_WEIGHT * popcnt(pieces & b.data.piece_bb[pieceidx(BISHOP)])
+             + MARGIN_ROOK_WEIGHT   * popcnt(pieces & b.data.piece_bb[pieceidx(ROOK)])
+             + MARGIN_KNIGHT_WEIGHT * popcnt(pieces & b.data.piece_bb[pieceidx(KNIGHT)])
+             + MARGIN_PAWN_WEIGHT   * popcnt(pieces & b.data.piece_bb[pieceidx(PAWN)]);
+    };
+
+    auto calc_victory_score = [&](U8 winner, U8 loser) {
+        int victory = 100 + calc_margin(winner) - calc_margin(loser);
         int winner_moves = (moves_played + 1) / 2;
         victory -= (5 * (winner_moves / 20)) + min(10, winner_moves);
         victory *= 1000;
         return victory;
     };
 
-    auto modify_pawn_weights = [&](U8* pieces, int* piece_weights, U8 promo_pos) {
-        for (int i = 4; i < 8; i++) {
+    auto modify_pawn_weights = [&](const U8* pieces, int* piece_weights, U8 promo_pos) {
+        for (int i = FIRST_PAWN_SLOT; i < MAX_PIECES; i++) {
             if (b.data.board_0[pieces[i]] & ROOK) {
                 piece_weights[i] = ROOK_WEIGHT;
             } else if (b.data.board_0[pieces[i]] & BISHOP) {
@@ -404,44 +502,37 @@ Evaluation eval(Board& b) {
     auto add_attack_score = [&]() {
         if (b.data.player_to_play == curr_player) {
             for (auto move : player_moves) {
-                U8 final_pos = getp1(move);
-                for (int i = 0; i < MAX_PIECES; i++) {
-                    if (final_pos == opponent_pieces[i] && !(b.data.board_0[opponent_pieces[i]] & KING)) {
-                        score.attack += OPPONENT_WEIGHTS[i] / ATTACKING_FACTOR;
-                    }
-                }
+                if (!iscapture(move) || (getcaptured(move) & KING)) continue;
+                score.attack += OPPONENT_WEIGHTS[b.data.slot_at(getp1(move)) % MAX_PIECES] / ATTACKING_FACTOR;
             }
         } else {
             for (auto move : opponent_moves) {
-                U8 final_pos = getp1(move);
-                for (int i = 0; i < MAX_PIECES; i++) {
-                    if (final_pos == player_pieces[i] && !(b.data.board_0[player_pieces[i]] & KING)) {
-                        score.attack -= PLAYER_WEIGHTS[i] / DEFENDING_FACTOR;
-                    }
-                }
+                if (!iscapture(move) || (getcaptured(move) & KING)) continue;
+                score.attack -= PLAYER_WEIGHTS[b.data.slot_at(getp1(move)) % MAX_PIECES] / DEFENDING_FACTOR;
             }
         }
     };
 
     auto subtract_check_score = [&]() {
         if (b.in_check()) {
-            if (b.get_legal_moves().empty()) {
+            if ((b.data.player_to_play == curr_player ? player_moves : opponent_moves).empty()) {
                 score.reset();
                 score.check = (b.data.player_to_play == curr_player ?
-                    -calc_victory_score(opponent_pieces, player_pieces) :
-                        calc_victory_score(player_pieces, opponent_pieces));
+                    -calc_victory_score(curr_player ^ (WHITE | BLACK), curr_player) :
+                        calc_victory_score(curr_player, curr_player ^ (WHITE | BLACK)));
             } else {
                 score.check += (b.data.player_to_play == curr_player ? -1 : 1) * CHECK_WEIGHT;
             }
         }
     };
 
-    auto calc_promo_score = [&](U8* pieces, U8 promo_pos) {
+    auto calc_promo_score = [&](const U8* pieces, U8 promo_pos) {
         int promo_score = 0;
         int promo_pos_y = gety(promo_pos);
         int piece_y, distance_y, pawn_distance;
-        vector<int> promo_scores;
-        for (int i = 4; i < 8; i++) {
+        int promo_scores[MAX_PIECES];
+        int n_promo_scores = 0;
+        for (int i = FIRST_PAWN_SLOT; i < MAX_PIECES; i++) {
             if (pieces[i] == DEAD || !(b.data.board_0[pieces[i]] & PAWN)) {
                 continue;
             }
@@ -457,19 +548,23 @@ Evaluation eval(Board& b) {
             } else {
                 promo_score = 60 / (1 + pawn_distance);
             }
-            promo_scores.push_back(promo_score);
+            // keep the scores sorted, highest first
+            int j = n_promo_scores++;
+            while (j > 0 && promo_scores[j - 1] < promo_score) {
+                promo_scores[j] = promo_scores[j - 1];
+                j--;
+            }
+            promo_scores[j] = promo_score;
         }
-        sort(promo_scores.begin(), promo_scores.end());
-        reverse(promo_scores.begin(), promo_scores.end());
         if (b.data.board_type == EIGHT_TWO) {
-            promo_score = (promo_scores.empty() ? 0 : promo_scores.back());
+            promo_score = (n_promo_scores == 0 ? 0 : promo_scores[n_promo_scores - 1]);
             int total_weight, weight, average;
             total_weight = average = 0;
-            for (int i = 0; i < (int)promo_scores.size() - 1; i++) {
+            for (int i = 0; i < n_promo_scores - 1; i++) {
                 if (i == 0) {
                     weight = 1;
                 } else {
-                    weight = (18 * i) / ((int)promo_scores.size() - 1);
+                    weight = (18 * i) / (n_promo_scores - 1);
                 }
                 total_weight += weight;
                 average += weight * promo_scores[i];
@@ -480,7 +575,7 @@ Evaluation eval(Board& b) {
         } else {
             int min_promo = INT_MAX;
             int max_promo = INT_MIN;
-            for (int i = promo_scores.size() - 1; i >= max(0, (int)promo_scores.size() - 2); i--) {
+            for (int i = n_promo_scores - 1; i >= max(0, n_promo_scores - 2); i--) {
                 min_promo = min(min_promo, promo_scores[i]);
                 max_promo = max(max_promo, promo_scores[i]);
             }
@@ -490,7 +585,7 @@ Evaluation eval(Board& b) {
             }
             min_promo = INT_MAX;
             max_promo = INT_MIN;
-            for (int i = max(-1, (int)promo_scores.size() - 3); i >= 0; i--) {
+            for (int i = max(-1, n_promo_scores - 3); i >= 0; i--) {
                 min_promo = min(min_promo, promo_scores[i]);
                 max_promo = max(max_promo, promo_scores[i]);
             }
@@ -501,7 +596,7 @@ Evaluation eval(Board& b) {
         return promo_score;
     };
 
-    auto calc_king_distance = [&](U8* pieces, int* piece_weights, U8 enemy_king) {
+    auto calc_king_distance = [&](const U8* pieces, int* piece_weights, U8 enemy_king) {
         int distance;
         int king_distance_score = 0;
         for (int i = 0; i < MAX_PIECES; i++) {
@@ -578,20 +673,8 @@ Evaluation eval(Board& b) {
     return score;
 }
 
-bool is_equal(Board* b1, Board* b2) {
-    bool is_king_equal = (b1->data.b_king == b2->data.b_king) && (b1->data.w_king == b2->data.w_king);
-    bool is_rook_1_equal = (b1->data.b_rook_1 == b2->data.b_rook_1) && (b1->data.w_rook_1 == b2->data.w_rook_1);
-    bool is_rook_2_equal = (b1->data.b_rook_2 == b2->data.b_rook_2) && (b1->data.w_rook_2 == b2->data.w_rook_2);
-    bool is_pawn_1_equal = (b1->data.b_pawn_1 == b2->data.b_pawn_1) && (b1->data.w_pawn_1 == b2->data.w_pawn_1);
-    bool is_pawn_2_equal = (b1->data.b_pawn_2 == b2->data.b_pawn_2) && (b1->data.w_pawn_2 == b2->data.w_pawn_2);
-    bool is_pawn_3_equal = (b1->data.b_pawn_3 == b2->data.b_pawn_3) && (b1->data.w_pawn_3 == b2->data.w_pawn_3);
-    bool is_pawn_4_equal = (b1->data.b_pawn_4 == b2->data.b_pawn_4) && (b1->data.w_pawn_4 == b2->data.w_pawn_4);
-    bool is_bishop_equal = (b1->data.b_bishop == b2->data.b_bishop) && (b1->data.w_bishop == b2->data.w_bishop);
-    bool is_knight_1_equal = (b1->data.b_knight_1 == b2->data.b_knight_1) && (b1->data.w_knight_1 == b2->data.w_knight_1);
-    bool is_knight_2_equal = (b1->data.b_knight_2 == b2->data.b_knight_2) && (b1->data.w_knight_2 == b2->data.w_knight_2);
-    bool is_equal = is_king_equal && is_rook_1_equal && is_rook_2_equal && is_pawn_1_equal && is_pawn_2_equal &&
-                        is_pawn_3_equal && is_pawn_4_equal && is_bishop_equal && is_knight_1_equal && is_knight_2_equal;
-    return is_equal;
+int clamp_score(int score) {
+    return max(-INFINITE_SCORE, min(INFINITE_SCORE, score));
 }
 
 bool is_better_eval(Evaluation& eval1, Evaluation& eval2, bool maximizing_player) {
@@ -601,124 +684,614 @@ bool is_better_eval(Evaluation& eval1, Evaluation& eval2, bool maximizing_player
     return res;
 }
 
-bool is_killer_move(U16 move, Board &b) {
-    U8 white_pieces[MAX_PIECES] = {b.data.w_rook_1, b.data.w_rook_2, b.data.w_king, b.data.w_bishop, b.data.w_pawn_1,
-                            b.data.w_pawn_2, b.data.w_pawn_3, b.data.w_pawn_4, b.data.w_knight_1, b.data.w_knight_2};
-    U8 black_pieces[MAX_PIECES] = {b.data.b_rook_1, b.data.b_rook_2, b.data.b_king, b.data.b_bishop, b.data.b_pawn_1,
-                            b.data.b_pawn_2, b.data.b_pawn_3, b.data.b_pawn_4, b.data.b_knight_1, b.data.b_knight_2};
+// State of one search: the board it makes and unmakes moves on, the
+// repetition history of the game and the search path, and per-ply buffers,
+// so that searching a node allocates nothing.
+struct SearchContext {
+
+    static const int MAX_PLY = 64;
 
-    U8* enemy_pieces = (b.data.player_to_play == WHITE ? black_pieces : white_pieces);
+    Board board;
+    HashHistory history;
+    TranspositionTable& tt;
+    chrono::time_point<chrono::system_clock> end_time;
+    const atomic<bool>* stop = nullptr;  // set to end the search before end_time
+    int nodes = 0;
 
-    U8 final_pos = getp1(move);
-    for (int i = 0; i < MAX_PIECES; i++) {
-        if (final_pos == enemy_pieces[i]) {
+    MoveHistory move_history;        // quiet move ordering statistics
+    U16 current_move[MAX_PLY];       // move being searched at each ply
+
+    // pv[ply][0 .. pv_length[ply]) is the best line found from the node at
+    // ply, starting with its best move
+    U16 pv[MAX_PLY][MAX_PLY];
+    int pv_length[MAX_PLY];
+
+    SearchContext(const Board& b, const HashHistory& game, TranspositionTable& tt, chrono::time_point<chrono::system_clock> end_time):
+        board(b), history(game), tt(tt), end_time(end_time) {
+        history.entries.reserve(game.entries.size() + MAX_PLY);
+    }
+
+    bool out_of_time() const {
+        if (stop && stop->load(memory_order_relaxed)) {
             return true;
         }
+        return chrono::high_resolution_clock::now() >= end_time;
+    }
+
+    void update_pv(int ply, U16 move) {
+        pv[ply][0] = move;
+        for (int i = 0; i < pv_length[ply + 1]; i++) {
+            pv[ply][i + 1] = pv[ply + 1][i];
+        }
+        pv_length[ply] = pv_length[ply + 1] + 1;
     }
-    return false;
+};
+
+// Material a capture or promotion gains, in the weights of eval.
+int capture_gain(U32 move) {
+    int gain = 0;
+    U8 captured = getcaptured(move);
+    if (captured & PAWN) gain += PAWN_WEIGHT;
+    else if (captured & ROOK) gain += ROOK_WEIGHT;
+    else if (captured & BISHOP) gain += BISHOP_WEIGHT;
+    else if (captured & KNIGHT) gain += KNIGHT_WEIGHT;
+    if (getpromo(move)) gain += ROOK_WEIGHT - PAWN_WEIGHT;
+    return gain;
 }
 
-Evaluation minimax(Board& board, int depth, bool maximizing_player, vector<Board*> &visited, int alpha, int beta, chrono::time_point<chrono::system_clock> end_time) {
+// Searches captures and promotions only, until the position is quiet, so
+// leaves are not evaluated in the middle of an exchange. The side to move
+// may stand pat on the static evaluation unless it is in check, in which
+// case all its moves are searched. Captures that lose material by static
+// exchange, or that cannot reach the window (delta pruning), are skipped.
+Evaluation quiescence(SearchContext& ctx, int ply, bool maximizing_player, int alpha, int beta) {
+    Board& board = ctx.board;
+    ctx.pv_length[ply] = 0;
+    TranspositionTable::Hit hit = {0, 0, -1, TranspositionTable::BOUND_NONE};
+    if (ctx.tt.probe(board.data.hash, hit)) {
+        if (hit.bound == TranspositionTable::BOUND_EXACT ||
+                (hit.bound == TranspositionTable::BOUND_LOWER && hit.score >= beta) ||
+                (hit.bound == TranspositionTable::BOUND_UPPER && hit.score <= alpha)) {
+            Evaluation cached;
+            cached.total = hit.score;
+            return cached;
+        }
+    }
+
+    bool in_check = board.in_check();
+    Evaluation stand_pat = eval(board);
+    if (ply >= SearchContext::MAX_PLY - 1) {
+        return stand_pat;
+    }
+    int alpha_orig = alpha;
+    int beta_orig = beta;
+    Evaluation best_eval;
+    best_eval.total = (maximizing_player ? INT_MIN : INT_MAX);
+    if (!in_check) {
+        best_eval = stand_pat;
+        if (maximizing_player) {
+            alpha = max(alpha, stand_pat.total);
+        } else {
+            beta = min(beta, stand_pat.total);
+        }
+    }
+
+    U16 best_move = 0;
+    MovePicker picker(board, 0, nullptr, ply, 0, !in_check);
+    for (U32 xm = picker.next(); xm && alpha < beta && !ctx.out_of_time(); xm = picker.next()) {
+        U16 move = getmove(xm);
+        if (!in_check) {
+            int gain = capture_gain(xm) + DELTA_MARGIN;
+            if (maximizing_player ? stand_pat.total + gain <= alpha : stand_pat.total - gain >= beta) {
+                continue;
+            }
+        }
+        ctx.current_move[ply] = move;
+        board.do_move_(move);
+        ctx.history.push(board.data);
+        ctx.nodes++;
+        Evaluation eval = quiescence(ctx, ply + 1, !maximizing_player, alpha, beta);
+        eval.depth++;
+        ctx.history.pop();
+        board.undo_move_(move);
+        if (is_better_eval(eval, best_eval, maximizing_player)) {
+            best_eval = eval;
+            best_move = move;
+            ctx.update_pv(ply, move);
+        }
+        if (maximizing_player) {
+            alpha = max(alpha, clamp_score(best_eval.total));
+        } else {
+            beta = min(beta, clamp_score(best_eval.total));
+        }
+    }
+    // in check with no legal move: eval has scored the mate
+    if (in_check && picker.n_picked == 0) {
+        best_eval = stand_pat;
+    }
+    if (!ctx.out_of_time() && best_eval.total != INT_MIN && best_eval.total != INT_MAX) {
+        TranspositionTable::Bound bound = (best_eval.total <= alpha_orig ? TranspositionTable::BOUND_UPPER :
+                best_eval.total >= beta_orig ? TranspositionTable::BOUND_LOWER : TranspositionTable::BOUND_EXACT);
+        ctx.tt.store(board.data.hash, 0, bound, best_eval.total, best_move);
+    }
+    return best_eval;
+}
+
+Evaluation minimax(SearchContext& ctx, int ply, int depth, bool maximizing_player, int alpha, int beta) {
+    Board& board = ctx.board;
     Evaluation best_eval;
-    if (previous_board_occurences.find(board_to_str(&board.data)) == previous_board_occurences.end()) {
-        // do nothing
-    } else if (previous_board_occurences[board_to_str(&board.data)] == 2) {
+    ctx.pv_length[ply] = 0;
+    if (ctx.history.game_count(board.data.hash) >= 2) {
         best_eval.total = (maximizing_player ? 1 : -1) * REPETITION_WEIGHT;
         return best_eval;
     }
-    if (depth == 0) {
-        return eval(board);
+    TranspositionTable::Hit hit = {0, 0, -1, TranspositionTable::BOUND_NONE};
+    if (ctx.tt.probe(board.data.hash, hit) && hit.depth >= depth) {
+        if (hit.bound == TranspositionTable::BOUND_EXACT ||
+                (hit.bound == TranspositionTable::BOUND_LOWER && hit.score >= beta) ||
+                (hit.bound == TranspositionTable::BOUND_UPPER && hit.score <= alpha)) {
+            best_eval.total = hit.score;
+            return best_eval;
+        }
     }
-    best_eval.total = (maximizing_player ? INT_MIN : INT_MAX);
-    auto player_moveset = board.get_legal_moves();
-    if (player_moveset.empty() && !board.in_check()) {
-        best_eval.total = (maximizing_player ? 1 : -1) * STALEMATE_WEIGHT;
-        return best_eval;
+    if (depth == 0 || ply >= SearchContext::MAX_PLY - 1) {
+        return quiescence(ctx, ply, maximizing_player, alpha, beta);
     }
-    for (auto iter = player_moveset.begin(); iter != player_moveset.end() && (chrono::high_resolution_clock::now() < end_time); iter++) {
-        auto move = *iter;
-        Board* new_board = new Board(board);
+    int alpha_orig = alpha;
+    int beta_orig = beta;
+    bool in_check = board.in_check();
 
-        new_board->do_move_(move);
-        bool is_visited_board = false;
-        for (Board* b : visited) {
-            if (is_equal(b, new_board)) {
-                is_visited_board = true;
-                break;
-            }
+    // null-move pruning: pass, and if the opponent still cannot reach the
+    // window with a reduced search, neither can any real move. Not in
+    // check, not twice in a row and not with only king and pawns, where
+    // passing may be the best move (zugzwang). Not against an infinite
+    // bound either: no score reaches it, so the search could never cut.
+    U64 own = board.data.color_bb[coloridx(board.data.player_to_play)];
+    U64 own_pieces = own & ~(board.data.piece_bb[pieceidx(KING)] | board.data.piece_bb[pieceidx(PAWN)]);
+    bool finite_bound = (maximizing_player ? beta < INFINITE_SCORE : alpha > -INFINITE_SCORE);
+    if (depth >= NULL_MOVE_MIN_DEPTH && !in_check && own_pieces && finite_bound && ply > 0 && ctx.current_move[ply - 1] != 0) {
+        int null_depth = max(0, depth - 1 - NULL_MOVE_REDUCTION);
+        ctx.current_move[ply] = 0;
+        board.flip_player_();
+        ctx.history.push(board.data, true);
+        ctx.nodes++;
+        Evaluation null_eval = (maximizing_player ?
+                minimax(ctx, ply + 1, null_depth, false, beta - 1, beta) :
+                minimax(ctx, ply + 1, null_depth, true, alpha, alpha + 1));
+        ctx.history.pop();
+        board.flip_player_();
+        ctx.pv_length[ply] = 0;
+        bool cut = (maximizing_player ? null_eval.total >= beta : null_eval.total <= alpha);
+        if (cut && !ctx.out_of_time() && abs(clamp_score(null_eval.total)) < WIN_SCORE) {
+            best_eval.total = null_eval.total;
+            return best_eval;
         }
-        if (is_visited_board) {
-            delete new_board;
+    }
+
+    U16 best_move = 0;
+    int searched = 0;
+    U16 quiets_tried[MoveList::capacity];
+    int n_quiets_tried = 0;
+    best_eval.total = (maximizing_player ? INT_MIN : INT_MAX);
+    MovePicker picker(board, hit.move, &ctx.move_history, ply, (ply > 0 ? ctx.current_move[ply - 1] : 0));
+    for (U32 xm = picker.next(); xm && !ctx.out_of_time(); xm = picker.next()) {
+        U16 move = getmove(xm);
+        bool quiet = !iscapture(xm) && !getpromo(move);
+        ctx.current_move[ply] = move;
+        board.do_move_(move);
+        ctx.history.push(board.data);
+        if (ctx.history.repeats_on_path()) {
+            ctx.history.pop();
+            board.undo_move_(move);
             continue;
         }
-        visited.push_back(new_board);
-        nodes_visited++;
-        Evaluation eval = minimax(*new_board, depth - 1, !maximizing_player, visited, alpha, beta, end_time);
+        ctx.nodes++;
+
+        // late move reduction: a quiet move ordered after the killers and
+        // the first few moves is searched shallower, unless it gives check
+        int reduction = 0;
+        if (depth >= LMR_MIN_DEPTH && searched >= LMR_MIN_MOVES && picker.stage == MovePicker::QUIETS &&
+                !in_check && !board.in_check()) {
+            reduction = LMR_REDUCTIONS[min(depth, LMR_TABLE_SIZE - 1)][min(searched, LMR_TABLE_SIZE - 1)];
+            reduction = max(0, min(reduction, depth - 2));
+        }
+
+        // principal variation search: the first move gets the full window,
+        // the rest a null window that only tells whether they beat it; a
+        // reduced move that does is searched again at full depth, then with
+        // the full window
+        Evaluation eval;
+        if (searched++ == 0) {
+            eval = minimax(ctx, ply + 1, depth - 1, !maximizing_player, alpha, beta);
+        } else if (maximizing_player) {
+            eval = minimax(ctx, ply + 1, depth - 1 - reduction, false, alpha, alpha + 1);
+            if (reduction > 0 && eval.total > alpha) {
+                eval = minimax(ctx, ply + 1, depth - 1, false, alpha, alpha + 1);
+            }
+            if (eval.total > alpha && eval.total < beta) {
+                eval = minimax(ctx, ply + 1, depth - 1, false, alpha, beta);
+            }
+        } else {
+            eval = minimax(ctx, ply + 1, depth - 1 - reduction, true, beta - 1, beta);
+            if (reduction > 0 && eval.total < beta) {
+                eval = minimax(ctx, ply + 1, depth - 1, true, beta - 1, beta);
+            }
+            if (eval.total < beta && eval.total > alpha) {
+                eval = minimax(ctx, ply + 1, depth - 1, true, alpha, beta);
+            }
+        }
         eval.depth++;
-        eval.moves.push_back(move);
-        delete new_board;
-        visited.pop_back();
+        ctx.history.pop();
+        board.undo_move_(move);
         if (is_better_eval(eval, best_eval, maximizing_player)) {
             best_eval = eval;
+            best_move = move;
+            ctx.update_pv(ply, move);
         }
         if (maximizing_player) {
-            alpha = max(alpha, best_eval.total);
+            alpha = max(alpha, clamp_score(best_eval.total));
         } else {
-            beta = min(beta, best_eval.total);
+            beta = min(beta, clamp_score(best_eval.total));
         }
         if (alpha >= beta) {
+            if (quiet) {
+                ctx.move_history.update(board.data.player_to_play, ply, depth, (ply > 0 ? ctx.current_move[ply - 1] : 0),
+                        move, quiets_tried, n_quiets_tried);
+            }
             break;
         }
+        if (quiet) {
+            quiets_tried[n_quiets_tried++] = move;
+        }
+    }
+    if (picker.n_picked == 0 && !in_check) {
+        best_eval.total = (maximizing_player ? 1 : -1) * STALEMATE_WEIGHT;
+    }
+    // a search cut short by the clock, or one with no move to score, says
+    // nothing about the position
+    if (!ctx.out_of_time() && best_eval.total != INT_MIN && best_eval.total != INT_MAX) {
+        TranspositionTable::Bound bound = (best_eval.total <= alpha_orig ? TranspositionTable::BOUND_UPPER :
+                best_eval.total >= beta_orig ? TranspositionTable::BOUND_LOWER : TranspositionTable::BOUND_EXACT);
+        ctx.tt.store(board.data.hash, depth, bound, best_eval.total, best_move);
     }
     return best_eval;
 }
 
-bool is_end_game(const Board& b) {
-    bool res = false;
-    U8 white_pieces[MAX_PIECES] = {b.data.w_rook_1, b.data.w_rook_2, b.data.w_king, b.data.w_bishop, b.data.w_pawn_1,
-                            b.data.w_pawn_2, b.data.w_pawn_3, b.data.w_pawn_4, b.data.w_knight_1, b.data.w_knight_2};
-    U8 black_pieces[MAX_PIECES] = {b.data.b_rook_1, b.data.b_rook_2, b.data.b_king, b.data.b_bishop, b.data.b_pawn_1,
-                            b.data.b_pawn_2, b.data.b_pawn_3, b.data.b_pawn_4, b.data.b_knight_1, b.data.b_knight_2};
+// Searches the root moves in order within the window (alpha, beta), with
+// principal variation search as in minimax. Returns the best score of the
+// moves whose search completed, leaving the best move and its line in
+// ctx.pv[0].
+Evaluation search_root(SearchContext& ctx, const MoveList& moves, int depth, int alpha, int beta) {
+    Evaluation best_eval;
+    best_eval.total = INT_MIN;
+    best_eval.depth = MAX_SEARCH_DEPTH;
+    ctx.pv_length[0] = 0;
+    int searched = 0;
+    for (U16 move : moves) {
+        if (ctx.out_of_time()) {
+            break;
+        }
+        ctx.current_move[0] = move;
+        ctx.board.do_move_(move);
+        ctx.history.push(ctx.board.data);
+        ctx.nodes++;
+        Evaluation eval;
+        if (searched++ == 0) {
+            eval = minimax(ctx, 1, depth, false, alpha, beta);
+        } else {
+            eval = minimax(ctx, 1, depth, false, alpha, alpha + 1);
+            if (eval.total > alpha && eval.total < beta) {
+                eval = minimax(ctx, 1, depth, false, alpha, beta);
+            }
+        }
+        eval.depth++;
 
-    int white_alive = 0;
-    int black_alive = 0;
+        if (!ctx.out_of_time() && is_better_eval(eval, best_eval, true)) {
+            best_eval = eval;
+            alpha = max(alpha, clamp_score(eval.total));
+            ctx.update_pv(0, move);
+        }
+        ctx.history.pop();
+        ctx.board.undo_move_(move);
+    }
+    return best_eval;
+}
 
-    for (int i = 0; i < MAX_PIECES; i++) {
-        if (white_pieces[i] != DEAD && !(b.data.board_0[white_pieces[i]] & PAWN)) {
-            white_alive++;
+// A worker's share of the root moves in search_root_split: indices into the
+// move list, taken from the front by the worker and stolen from the back by
+// workers that have run out.
+struct RootQueue {
+    mutex lock;
+    deque<int> moves;
+};
+
+// The helper threads of search_root_split, started once per move search
+// rather than once per iteration. Each helper has its own context and
+// root move queue (the caller's queue is queues[0]); between jobs the
+// helpers wait on wake until run posts the next one.
+struct RootSplitPool {
+    deque<SearchContext> contexts;  // contexts[w - 1] is helper w's
+    vector<RootQueue> queues;
+    vector<thread> threads;
+
+    mutex lock;
+    condition_variable wake, done;
+    function<void(int)> job;
+    int generation = 0;  // jobs posted so far
+    int busy = 0;        // helpers still running the current job
+    bool quit = false;
+
+    RootSplitPool(int n_helpers, const Board& b, const HashHistory& game, TranspositionTable& tt,
+                  chrono::time_point<chrono::system_clock> end_time):
+        queues(n_helpers + 1) {
+        for (int w = 1; w <= n_helpers; w++) {
+            contexts.emplace_back(b, game, tt, end_time);
         }
-        if (black_pieces[i] != DEAD && !(b.data.board_0[black_pieces[i]] & PAWN)) {
-            black_alive++;
+        for (int w = 1; w <= n_helpers; w++) {
+            threads.emplace_back([this, w]() { helper_loop(w); });
         }
     }
-    res = (white_alive <= 3) || (black_alive <= 3);
-    return res;
+
+    ~RootSplitPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (thread& t : threads) {
+            t.join();
+        }
+    }
+
+    void helper_loop(int w) {
+        int seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&]() { return quit || generation != seen; });
+            if (quit) {
+                return;
+            }
+            seen = generation;
+            guard.unlock();
+            job(w);
+            guard.lock();
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    // Runs f(w) on every helper w and f(0) on the calling thread, and
+    // returns when all of them have.
+    void run(function<void(int)> f) {
+        {
+            lock_guard<mutex> guard(lock);
+            job = f;
+            busy = threads.size();
+            generation++;
+        }
+        wake.notify_all();
+        job(0);
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&]() { return busy == 0; });
+    }
+};
+
+// search_root with the root moves divided among the caller and the
+// helpers of pool: the first move is searched alone with the full window,
+// as in search_root, then the rest are dealt to the workers' queues in
+// turn, and a worker that runs out of moves steals from the others. Each
+// worker searches with its own context (board, history, move ordering),
+// and every search starts from the best score found so far by any of them.
+Evaluation search_root_split(SearchContext& ctx, RootSplitPool& pool, const MoveList& moves, int depth,
+                             int alpha, int beta) {
+    Evaluation best_eval;
+    best_eval.total = INT_MIN;
+    best_eval.depth = MAX_SEARCH_DEPTH;
+    ctx.pv_length[0] = 0;
+    if (moves.empty() || ctx.out_of_time()) {
+        return best_eval;
+    }
+
+    U16 first = moves[0];
+    ctx.current_move[0] = first;
+    ctx.board.do_move_(first);
+    ctx.history.push(ctx.board.data);
+    ctx.nodes++;
+    Evaluation first_eval = minimax(ctx, 1, depth, false, alpha, beta);
+    first_eval.depth++;
+    ctx.history.pop();
+    ctx.board.undo_move_(first);
+    if (ctx.out_of_time()) {
+        return best_eval;
+    }
+    best_eval = first_eval;
+    ctx.update_pv(0, first);
+    if (best_eval.total >= beta) {
+        return best_eval;
+    }
+
+    int n_workers = pool.queues.size();
+    vector<RootQueue>& queues = pool.queues;
+    for (RootQueue& queue : queues) {
+        queue.moves.clear();
+    }
+    for (int i = 1; i < moves.count; i++) {
+        queues[(i - 1) % n_workers].moves.push_back(i);
+    }
+
+    atomic<int> shared_alpha(max(alpha, clamp_score(best_eval.total)));
+    mutex best_lock;
+    U16 best_line[SearchContext::MAX_PLY];
+    int best_line_length = ctx.pv_length[0];
+    copy(ctx.pv[0], ctx.pv[0] + ctx.pv_length[0], best_line);
+
+    auto next_move = [&](int w) {
+        for (int i = 0; i < n_workers; i++) {
+            RootQueue& queue = queues[(w + i) % n_workers];
+            lock_guard<mutex> guard(queue.lock);
+            if (queue.moves.empty()) {
+                continue;
+            }
+            int m;
+            if (i == 0) {
+                m = queue.moves.front();
+                queue.moves.pop_front();
+            } else {
+                m = queue.moves.back();
+                queue.moves.pop_back();
+            }
+            return m;
+        }
+        return -1;
+    };
+
+    auto worker = [&](int w) {
+        SearchContext& wctx = (w == 0 ? ctx : pool.contexts[w - 1]);
+        for (int i = next_move(w); i != -1 && !wctx.out_of_time(); i = next_move(w)) {
+            int a = shared_alpha.load();
+            if (a >= beta) {
+                break;
+            }
+            U16 move = moves[i];
+            wctx.current_move[0] = move;
+            wctx.board.do_move_(move);
+            wctx.history.push(wctx.board.data);
+            wctx.nodes++;
+            Evaluation eval = minimax(wctx, 1, depth, false, a, a + 1);
+            if (eval.total > a && eval.total < beta) {
+                eval = minimax(wctx, 1, depth, false, a, beta);
+            }
+            eval.depth++;
+            wctx.history.pop();
+            wctx.board.undo_move_(move);
+
+            if (!wctx.out_of_time()) {
+                wctx.update_pv(0, move);
+                lock_guard<mutex> guard(best_lock);
+                if (is_better_eval(eval, best_eval, true)) {
+                    best_eval = eval;
+                    best_line_length = wctx.pv_length[0];
+                    copy(wctx.pv[0], wctx.pv[0] + wctx.pv_length[0], best_line);
+                    // only ever raised, by the holder of best_lock
+                    if (clamp_score(eval.total) > shared_alpha.load()) {
+                        shared_alpha.store(clamp_score(eval.total));
+                    }
+                }
+            }
+        }
+    };
+
+    pool.run(worker);
+
+    copy(best_line, best_line + best_line_length, ctx.pv[0]);
+    ctx.pv_length[0] = best_line_length;
+    return best_eval;
+}
+
+// The outcome of one thread's iterative deepening: the best move, its score
+// and line, the depth of the iteration that found them, and the deepest
+// iteration the thread finished. depth may be deeper than completed_depth
+// if a move beat the window before the clock stopped an iteration.
+struct RootResult {
+    U16 move = 0;
+    int score = 0;
+    int depth = 0;
+    int completed_depth = 0;
+    U16 line[SearchContext::MAX_PLY];
+    int line_length = 0;
+    int nodes = 0;
+};
+
+// Searches the root moves at first_depth, then one ply deeper each time
+// until MAX_SEARCH_DEPTH or the clock stops it, each iteration in an
+// aspiration window around the previous score. moves is reordered so each
+// iteration starts from the best move so far. With split, the root moves
+// are searched in parallel by ctx and the helpers of split.
+void iterative_deepening(SearchContext& ctx, MoveList& moves, int first_depth, RootResult& result,
+                         RootSplitPool* split = nullptr) {
+    for (int depth = first_depth; depth < MAX_SEARCH_DEPTH && !ctx.out_of_time(); depth++) {
+
+        // aspiration window around the previous iteration's score
+        int delta = ASPIRATION_WINDOW;
+        bool full_window = (result.move == 0 || abs(result.score) >= WIN_SCORE);
+        int alpha = (full_window ? -INFINITE_SCORE : result.score - delta);
+        int beta = (full_window ? INFINITE_SCORE : result.score + delta);
+        while (true) {
+            Evaluation eval = (split ? search_root_split(ctx, *split, moves, depth, alpha, beta) :
+                    search_root(ctx, moves, depth, alpha, beta));
+            bool fail_low = (eval.total <= alpha && alpha != -INFINITE_SCORE);
+            bool fail_high = (eval.total >= beta && beta != INFINITE_SCORE);
+
+            // a move that beat the window is kept even if the clock stops
+            // the iteration
+            if (ctx.pv_length[0] > 0 && !fail_low && (!ctx.out_of_time() || eval.total > alpha)) {
+                result.move = ctx.pv[0][0];
+                result.line_length = ctx.pv_length[0] - 1;
+                copy(ctx.pv[0] + 1, ctx.pv[0] + ctx.pv_length[0], result.line);
+                result.score = clamp_score(eval.total);
+                result.depth = depth;
+            }
+            if (ctx.out_of_time()) {
+                break;
+            }
+            if (!(fail_low || fail_high)) {
+                result.completed_depth = depth;
+                break;
+            }
+            delta *= 2;
+            if (fail_low) {
+                alpha = (delta > ASPIRATION_MAX_WINDOW ? -INFINITE_SCORE : result.score - delta);
+            } else {
+                beta = (delta > ASPIRATION_MAX_WINDOW ? INFINITE_SCORE : result.score + delta);
+            }
+        }
+        // the next iteration starts from the best move so far
+        auto best = find(moves.begin(), moves.end(), result.move);
+        if (best != moves.end()) rotate(moves.begin(), best, best + 1);
+    }
+}
+
+bool is_end_game(const Board& b) {
+    U64 non_pawns = ~b.data.piece_bb[pieceidx(PAWN)];
+    int white_alive = popcnt(b.data.color_bb[coloridx(WHITE)] & non_pawns);
+    int black_alive = popcnt(b.data.color_bb[coloridx(BLACK)] & non_pawns);
+    return (white_alive <= 3) || (black_alive <= 3);
 }
 
+Engine::Engine(): tt(TT_SIZE_MB) {}
+
 void Engine::find_best_move(const Board& b) {
     start_time = chrono::high_resolution_clock::now();
     if (this->current_player == -1) {
         moves_played = 0;
-        previous_board_occurences.clear();
+        this->tt.clear();
+        history.clear();
         total_time = this->time_left.count();
         this->current_player = b.data.player_to_play;
         curr_player = b.data.player_to_play;
         init_quadrant_map(b.data.board_type);
         init_promo(b.data.board_type);
         init_distances(b.data.board_type);
+        init_reductions(b.data.board_type);
     }
     double remaining_time = this->time_left.count();
-    previous_board_occurences[board_to_str(&b.data)]++;
+    history.push(b.data);
+    history.start_path();
     moves_played++;
-    Evaluation best_eval;
-    best_eval.total = INT_MIN;
-    best_eval.depth = MAX_SEARCH_DEPTH;
-    auto player_moveset = b.get_legal_moves();
+    MoveList player_moveset;
+    b.get_legal_moves(player_moveset);
     this->best_move = 0;
-    vector<Board*> visited;
-    nodes_visited = 0;
-    Board* board_copy = new Board(b);
-    double current_eval = eval(*board_copy).total;
+    this->tt.new_search();
+
+    // search the move the table holds for this position first
+    TranspositionTable::Hit root_hit;
+    if (this->tt.probe(b.data.hash, root_hit)) {
+        auto hash_move = find(player_moveset.begin(), player_moveset.end(), root_hit.move);
+        if (hash_move != player_moveset.end()) rotate(player_moveset.begin(), hash_move, hash_move + 1);
+    }
+    SearchContext ctx(b, history, this->tt, start_time);
+    double current_eval = eval(ctx.board).total;
     int base_time = (b.data.board_type == EIGHT_TWO ? 4000 : 2500);
     bool end_game = is_end_game(b);
     cout << "number of moves till now: " << moves_played - 1 << endl;
@@ -736,7 +1309,7 @@ void Engine::find_best_move(const Board& b) {
         DEFENDING_FACTOR = 8;
     }
     if (player_moveset.empty()) {
-        eval(*board_copy).print();
+        eval(ctx.board).print();
         return;
     }
     int move_time = min(
@@ -745,56 +1318,73 @@ void Engine::find_best_move(const Board& b) {
     );
     // int move_time = int(remaining_time);
     auto end_time = start_time + chrono::milliseconds(move_time);
-    int max_depth_visited = 0;
-    for (int depth = MIN_SEARCH_DEPTH - 1; depth < MAX_SEARCH_DEPTH && (chrono::high_resolution_clock::now() < end_time); depth++) {
-        int alpha = INT_MIN;
-        int beta = INT_MAX;
-        max_depth_visited = depth;
-        for (auto iter = player_moveset.begin(); iter != player_moveset.end() && (chrono::high_resolution_clock::now() < end_time); iter++) {
-            auto move = *iter;
-            Board* new_board = new Board(b);
-            new_board->do_move_(move);
-            visited.push_back(new_board);
-            nodes_visited++;
-            Evaluation eval = minimax(*new_board, depth, false, visited, alpha, beta, end_time);
-            eval.depth++;
-            visited.pop_back();
-
-            // if (is_better_eval(eval, best_eval, true)) {
-            //     best_eval = eval;
-            //     this->best_move = move;
-            //     alpha = eval.total;
-            // }
-
-            // Quiescence search
-            if (is_better_eval(eval, best_eval, true)) {
-                for (int i = (int)eval.moves.size() - 1; i >= 0; i--) {
-                    new_board->do_move_(eval.moves[i]);
-                }
-                nodes_visited++;
-                Evaluation new_eval = minimax(*new_board, QUIESCENCE_DEPTH, (eval.depth % 2 == 0), visited, INT_MIN, INT_MAX, end_time);
-                if (new_eval.total - eval.total >= 0 || best_eval.total == INT_MIN) {
-                    best_eval = eval;
-                    this->best_move = move;
-                    alpha = eval.total;
-                }
-            }
-            delete new_board;
+    ctx.end_time = end_time;
+
+    int n_threads = max(1, this->threads);
+    vector<RootResult> results(n_threads);
+    if (n_threads > 1 && this->split_root) {
+        // root splitting: the threads share each iteration's root moves
+        RootSplitPool split(n_threads - 1, b, history, this->tt, end_time);
+        iterative_deepening(ctx, player_moveset, MIN_SEARCH_DEPTH - 1, results[0], &split);
+        results[0].nodes = ctx.nodes;
+        for (const SearchContext& helper_ctx : split.contexts) {
+            results[0].nodes += helper_ctx.nodes;
         }
+    } else {
+        // lazy SMP: helper threads run the same iterative deepening on their
+        // own copy of the position, sharing only the transposition table, and
+        // every other helper starts a ply deeper so the threads spread over
+        // depths. What one thread stores, the others pick up as cutoffs and
+        // hash moves.
+        atomic<bool> stop(false);
+        vector<thread> helpers;
+        for (int t = 1; t < n_threads; t++) {
+            helpers.emplace_back([&, t, moves = player_moveset]() mutable {
+                SearchContext helper_ctx(b, history, this->tt, end_time);
+                helper_ctx.stop = &stop;
+                iterative_deepening(helper_ctx, moves, MIN_SEARCH_DEPTH - 1 + t % 2, results[t]);
+                results[t].nodes = helper_ctx.nodes;
+            });
+        }
+        iterative_deepening(ctx, player_moveset, MIN_SEARCH_DEPTH - 1, results[0]);
+        results[0].nodes = ctx.nodes;
+        stop = true;
+        for (thread& helper : helpers) {
+            helper.join();
+        }
+    }
+
+    // the thread that finished the deepest iteration wins, the main
+    // thread on a tie; only if none finished one, the deepest partial result
+    const RootResult* best = &results[0];
+    int nodes = 0;
+    for (const RootResult& result : results) {
+        bool deeper = (result.completed_depth > best->completed_depth ||
+                (best->completed_depth == 0 && result.completed_depth == 0 && result.depth > best->depth));
+        if (result.move != 0 && deeper) {
+            best = &result;
+        }
+        nodes += result.nodes;
+    }
+    this->best_move = best->move;
+    if (this->best_move == 0) {
+        this->best_move = player_moveset[0];
     }
-    cout << board_to_str(&board_copy->data) << endl;
+    const U16* best_line = best->line;
+    int best_line_length = best->line_length;
+    int max_depth_visited = best->depth;
+    cout << board_to_str(&ctx.board.data) << endl;
     cout << "Move sequence: " << move_to_str(best_move) << ' ';
-    for (int it = best_eval.moves.size() - 1; it >= 0; it--) {
-        cout << move_to_str(best_eval.moves[it]) << " \n"[it == 0];
+    for (int i = 0; i < best_line_length; i++) {
+        cout << move_to_str(best_line[i]) << " \n"[i == best_line_length - 1];
     }
     end_time = chrono::high_resolution_clock::now();
-    board_copy->do_move_(best_move);
-    previous_board_occurences[board_to_str(&board_copy->data)]++;
+    ctx.board.do_move_(best_move);
+    history.push(ctx.board.data);
     moves_played++;
-    eval(*board_copy).print();
-    delete board_copy;
+    eval(ctx.board).print();
     // best_eval.print();
     cout << "found best move in " << chrono::duration_cast<chrono::duration<double>>(end_time - start_time).count() << " seconds" << endl;
-    cout << "nodes visited " << nodes_visited << endl;
+    cout << "nodes visited " << nodes << endl;
     cout << "max depth reached " << max_depth_visited << endl;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "engine_base.hpp"
+#include "tt.hpp"
 #include <atomic>
 
 class Engine : public AbstractEngine {
@@ -11,6 +12,11 @@ class Engine : public AbstractEngine {
     
     public:
     int current_player = -1;
+    TranspositionTable tt;   /* Kept across moves of a game. */
+    int threads = 1;         /* Search threads; more than one shares tt (lazy SMP). */
+    bool split_root = false; /* With threads > 1, divide the root moves among the threads instead. */
+
+    Engine();
     void find_best_move(const Board& b) override;
 
 };
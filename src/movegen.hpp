@@ -0,0 +1,97 @@
+#pragma once
+
+#include "board.hpp"
+#include "bgeom.hpp"
+#include "constants.hpp"
+
+// Building blocks of move generation shared by Board and the batch generator
+// in batchgen.cpp. All of them work on bitboards and the geometry tables of
+// bgeom.hpp, templated on the board type where they need the tables.
+
+// Appends a move to a list, filling in the moving and captured piece from
+// board when the list holds extended moves. Any other list only needs a
+// push(U16) and may pass a null board.
+template <typename List>
+inline void push_move(List& moves, const U8 *board, U16 m) {
+    moves.push(m);
+}
+
+inline void push_move(ExtMoveList& moves, const U8 *board, U16 m) {
+    moves.push(xmove(m, board[getp0(m)], board[getp1(m)]));
+}
+
+template <typename List>
+void construct_moves(const U8 *board, const U8 p0, const U64 targets, List& moves) {
+
+    U64 bb = targets;
+    while (bb) push_move(moves, board, move(p0, pop_lsb(bb)));
+}
+
+template <typename List>
+void construct_pawn_moves(const U8 *board, const U8 p0, const U64 targets, const U64 promo, List& pawn_moves) {
+
+    U64 bb = targets;
+    while (bb) {
+        U8 p1 = pop_lsb(bb);
+        if (promo & sqbit(p1)) {
+            push_move(pawn_moves, board, move_promo(p0, p1, PAWN_ROOK));
+            push_move(pawn_moves, board, move_promo(p0, p1, PAWN_BISHOP));
+        }
+        else {
+            push_move(pawn_moves, board, move(p0, p1));
+        }
+    }
+}
+
+// Attack detection against explicit occupancies: piece_bb are the piece
+// bitboards of a BoardData, them the attacking pieces and occ all pieces, so
+// callers can ask about a position that differs from the board by a move
+// without making it.
+
+template <BoardType BT>
+bool square_attacked(const U64 *piece_bb, U8 square, U64 them, U64 occ) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+
+    // stepping pieces: one mask test each (pawns use the reverse table)
+    if (geom.king_moves[square]   & them & piece_bb[pieceidx(KING)])   return true;
+    if (geom.knight_moves[square] & them & piece_bb[pieceidx(KNIGHT)]) return true;
+    if (geom.pawn_sources[square] & them & piece_bb[pieceidx(PAWN)])   return true;
+
+    // sliding pieces: only those standing on a reverse ray of the square, and
+    // only if nothing stands between them and it
+    U64 rooks = geom.slider_sources[RAY_ROOK][square] & them & piece_bb[pieceidx(ROOK)];
+    while (rooks) {
+        if (slider_reaches<BT, RAY_ROOK>(pop_lsb(rooks), square, occ)) return true;
+    }
+    U64 bishops = geom.slider_sources[RAY_BISHOP][square] & them & piece_bb[pieceidx(BISHOP)];
+    while (bishops) {
+        if (slider_reaches<BT, RAY_BISHOP>(pop_lsb(bishops), square, occ)) return true;
+    }
+
+    return false;
+}
+
+template <BoardType BT>
+U64 attackers_of(const U64 *piece_bb, U8 square, U64 them, U64 occ) {
+
+    constexpr const BoardGeometry &geom = board_geometry[BT];
+
+    U64 attackers = (geom.king_moves[square] & piece_bb[pieceidx(KING)])
+                  | (geom.knight_moves[square] & piece_bb[pieceidx(KNIGHT)])
+                  | (geom.pawn_sources[square] & piece_bb[pieceidx(PAWN)]);
+    attackers &= them;
+
+    U64 rooks = geom.slider_sources[RAY_ROOK][square] & them & piece_bb[pieceidx(ROOK)];
+    while (rooks) {
+        U8 s = pop_lsb(rooks);
+        if (slider_reaches<BT, RAY_ROOK>(s, square, occ)) attackers |= sqbit(s);
+    }
+    U64 bishops = geom.slider_sources[RAY_BISHOP][square] & them & piece_bb[pieceidx(BISHOP)];
+    while (bishops) {
+        U8 s = pop_lsb(bishops);
+        if (slider_reaches<BT, RAY_BISHOP>(s, square, occ)) attackers |= sqbit(s);
+    }
+
+    return attackers;
+}
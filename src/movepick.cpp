@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cstring>
+#include "movepick.hpp"
+#include "bgeom.hpp"
+#include "constants.hpp"
+
+MoveHistory::MoveHistory() {
+    this->clear();
+}
+
+void MoveHistory::clear() {
+    memset(this->killers, 0, sizeof(this->killers));
+    memset(this->butterfly, 0, sizeof(this->butterfly));
+    memset(this->countermoves, 0, sizeof(this->countermoves));
+}
+
+// Moves a butterfly score towards +-max_score by bonus, by less the closer
+// it already is, so scores stay bounded and recent cutoffs count most.
+inline void apply_bonus(int &score, int bonus) {
+    score += bonus - score * abs(bonus) / MoveHistory::max_score;
+}
+
+void MoveHistory::update(U8 color, int ply, int depth, U16 prev_move, U16 move, const U16 *tried, int n_tried) {
+
+    if (ply < max_ply && this->killers[ply][0] != move) {
+        this->killers[ply][1] = this->killers[ply][0];
+        this->killers[ply][0] = move;
+    }
+    if (prev_move) {
+        this->countermoves[getp0(prev_move)][getp1(prev_move)] = move;
+    }
+
+    int bonus = std::min(depth * depth, max_score / 4);
+    int (*table)[64] = this->butterfly[coloridx(color)];
+    apply_bonus(table[getp0(move)][getp1(move)], bonus);
+    for (int i=0; i<n_tried; i++) {
+        apply_bonus(table[getp0(tried[i])][getp1(tried[i])], -bonus);
+    }
+}
+
+MovePicker::MovePicker(const Board &board, U16 hash_move, const MoveHistory *history, int ply, U16 prev_move,
+                       bool captures_only):
+    board(board),
+    hash_move(captures_only ? 0 : hash_move),
+    history(history),
+    captures_only(captures_only) {
+
+    this->killers[0] = this->killers[1] = this->killers[2] = 0;
+    if (history && ply < MoveHistory::max_ply) {
+        this->killers[0] = history->killers[ply][0];
+        this->killers[1] = history->killers[ply][1];
+    }
+    if (history && prev_move) {
+        this->killers[2] = history->countermoves[getp0(prev_move)][getp1(prev_move)];
+    }
+}
+
+// True if the quiet stage must skip m because an earlier stage returned it.
+inline bool picked_early(const MovePicker &picker, U16 m) {
+    return m == picker.hash_move || m == picker.killers[0] || m == picker.killers[1] || m == picker.killers[2];
+}
+
+U32 MovePicker::next() {
+
+    const BoardData &data = this->board.data;
+    U8 color = data.player_to_play;
+    U64 them = data.color_bb[coloridx(color ^ (WHITE | BLACK))];
+    U64 empty = data.valid_squares & ~(data.color_bb[0] | data.color_bb[1]);
+
+    switch (this->stage) {
+
+    case HASH_MOVE:
+        this->stage = GEN_CAPTURES;
+        if (this->hash_move && this->board.is_legal_move(this->hash_move)) {
+            this->n_picked++;
+            return xmove(this->hash_move, data.board_0[getp0(this->hash_move)],
+                    data.board_0[getp1(this->hash_move)]);
+        }
+        this->hash_move = 0;
+        [[fallthrough]];
+
+    case GEN_CAPTURES:
+        this->moves.clear();
+        this->board.get_legal_moves(this->moves, them);
+        for (int i=0; i<this->moves.count; i++) {
+            U32 m = this->moves[i];
+            this->scores[i] = 16 * piece_value[pieceidx(getcaptured(m))] - piece_value[pieceidx(getpiece(m))];
+        }
+        this->idx = 0;
+        this->stage = CAPTURES;
+        [[fallthrough]];
+
+    case CAPTURES:
+        // selection sort, one step per call: most captures are never reached
+        while (this->idx < this->moves.count) {
+            int best = this->idx;
+            for (int i=this->idx+1; i<this->moves.count; i++) {
+                if (this->scores[i] > this->scores[best]) best = i;
+            }
+            std::swap(this->moves.moves[best], this->moves.moves[this->idx]);
+            std::swap(this->scores[best], this->scores[this->idx]);
+
+            U32 m = this->moves[this->idx++];
+            if (getmove(m) == this->hash_move) continue;
+
+            // captures of a less valuable piece may lose material: defer them
+            // if they do
+            if (piece_value[pieceidx(getcaptured(m))] < piece_value[pieceidx(getpiece(m))] &&
+                    this->board.see(getmove(m)) < 0) {
+                this->bad_captures[this->n_bad_captures++] = m;
+                continue;
+            }
+            this->n_picked++;
+            return m;
+        }
+        this->stage = GEN_PROMOTIONS;
+        [[fallthrough]];
+
+    case GEN_PROMOTIONS:
+        this->moves.clear();
+        this->board.get_legal_moves(this->moves,
+                empty & board_geometry[data.board_type].promo_squares[coloridx(color)]);
+        this->idx = 0;
+        this->stage = PROMOTIONS;
+        [[fallthrough]];
+
+    case PROMOTIONS:
+        while (this->idx < this->moves.count) {
+            U32 m = this->moves[this->idx++];
+            if (!getpromo(m) || getmove(m) == this->hash_move) continue;
+            this->n_picked++;
+            return m;
+        }
+        if (this->captures_only) {
+            this->stage = DONE;
+            break;
+        }
+        this->idx = 0;
+        this->stage = KILLERS;
+        [[fallthrough]];
+
+    case KILLERS:
+        // killers come from other positions: only quiet legal moves that no
+        // earlier stage or killer returned
+        while (this->idx < 3) {
+            int i = this->idx++;
+            U16 m = this->killers[i];
+            bool repeated = (m == this->hash_move) || (i > 0 && m == this->killers[0]) || (i > 1 && m == this->killers[1]);
+            if (!m || repeated || getpromo(m) || data.board_0[getp1(m)] || !this->board.is_legal_move(m)) {
+                this->killers[i] = 0;
+                continue;
+            }
+            this->n_picked++;
+            return xmove(m, data.board_0[getp0(m)], 0);
+        }
+        this->stage = GEN_QUIETS;
+        [[fallthrough]];
+
+    case GEN_QUIETS:
+        this->moves.clear();
+        this->board.get_legal_moves(this->moves, empty);
+        for (int i=0; i<this->moves.count; i++) {
+            this->scores[i] = this->history ? this->history->score(color, getmove(this->moves[i])) : 0;
+        }
+        this->idx = 0;
+        this->stage = QUIETS;
+        [[fallthrough]];
+
+    case QUIETS:
+        while (this->idx < this->moves.count) {
+            if (this->history) {
+                int best = this->idx;
+                for (int i=this->idx+1; i<this->moves.count; i++) {
+                    if (this->scores[i] > this->scores[best]) best = i;
+                }
+                std::swap(this->moves.moves[best], this->moves.moves[this->idx]);
+                std::swap(this->scores[best], this->scores[this->idx]);
+            }
+
+            U32 m = this->moves[this->idx++];
+            if (getpromo(m) || picked_early(*this, getmove(m))) continue;
+            this->n_picked++;
+            return m;
+        }
+        this->idx = 0;
+        this->stage = BAD_CAPTURES;
+        [[fallthrough]];
+
+    case BAD_CAPTURES:
+        if (this->idx < this->n_bad_captures) {
+            this->n_picked++;
+            return this->bad_captures[this->idx++];
+        }
+        this->stage = DONE;
+        [[fallthrough]];
+
+    case DONE:
+        break;
+    }
+
+    return 0;
+}
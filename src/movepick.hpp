@@ -0,0 +1,123 @@
+#pragma once
+
+#include "board.hpp"
+#include "constants.hpp"
+
+/**
+ * @brief Statistics on quiet moves that caused beta cutoffs, for ordering
+ * the quiet moves of later nodes.
+ *
+ * - killers: the last two quiet moves that cut off at each ply
+ * - butterfly: a score per side, source and target square, raised for quiet
+ *   moves that cut off and lowered for those searched before them
+ * - countermoves: the quiet move that last cut off in reply to a move,
+ *   indexed by that move's source and target square
+ */
+struct MoveHistory {
+
+  static const int max_ply = 64;
+  static const int max_score = 16384; /* Bound on butterfly scores. */
+
+  U16 killers[max_ply][2];
+  int butterfly[2][64][64];
+  U16 countermoves[64][64];
+
+  MoveHistory();
+
+  /**
+   * @brief Forgets everything.
+   */
+  void clear();
+
+  /**
+   * @brief Records a beta cutoff by a quiet move.
+   *
+   * @param color The side that played move.
+   * @param ply The ply of the node move was played at.
+   * @param depth The depth the node was searched to.
+   * @param prev_move The move that led to the node, 0 if none.
+   * @param move The move that cut off.
+   * @param tried The quiet moves searched before it at the node.
+   * @param n_tried The number of moves in tried.
+   */
+  void update(U8 color, int ply, int depth, U16 prev_move, U16 move, const U16 *tried, int n_tried);
+
+  /**
+   * @brief The butterfly score of a quiet move.
+   */
+  int score(U8 color, U16 move) const {
+    return this->butterfly[coloridx(color)][getp0(move)][getp1(move)];
+  }
+};
+
+/**
+ * @brief Hands out the legal moves of a position one at a time, in stages.
+ *
+ * The stages are the hash move, winning and equal captures (most valuable
+ * victim first, then least valuable attacker), promotions, the killer moves
+ * and countermove of the node, the other quiet moves by butterfly score and
+ * finally the captures that lose material by static exchange. Without a
+ * MoveHistory the killer stage is empty and quiet moves come in generation
+ * order. A picker for captures only, as in a quiescence search, stops after
+ * the promotions: it never returns quiet moves or losing captures. A stage's
+ * moves are only generated once the previous stage is used up, so a search
+ * that cuts off on an early move never pays for generating the rest.
+ *
+ * The board must not change while the picker is in use, other than by moves
+ * that are undone before the next call to next().
+ */
+struct MovePicker {
+
+  enum Stage {
+    HASH_MOVE,
+    GEN_CAPTURES,
+    CAPTURES,
+    GEN_PROMOTIONS,
+    PROMOTIONS,
+    KILLERS,
+    GEN_QUIETS,
+    QUIETS,
+    BAD_CAPTURES,
+    DONE
+  };
+
+  const Board &board;
+  U16 hash_move;
+  const MoveHistory *history;
+  bool captures_only;
+  Stage stage = HASH_MOVE;
+
+  U16 killers[3];     /* Killers and countermove of the node, 0 if unused. */
+
+  ExtMoveList moves;  /* Moves of the current stage. */
+  int scores[MoveList::capacity];
+  int idx = 0;        /* Next move of the current stage to hand out. */
+
+  U32 bad_captures[MoveList::capacity]; /* Captures with Board::see < 0. */
+  int n_bad_captures = 0;
+  int n_picked = 0;   /* Moves handed out so far, over all stages. */
+
+  /**
+   * @brief Constructor.
+   *
+   * @param board The position to pick moves from.
+   * @param hash_move A move to try first, e.g. from the transposition table,
+   * or 0 for none. It is checked for legality before it is returned.
+   * @param history Ordering statistics for quiet moves, or null for none.
+   * @param ply The ply of the node, to look up its killers.
+   * @param prev_move The move that led to the node, to look up its
+   * countermove, or 0 for none.
+   * @param captures_only Return only captures that do not lose material and
+   * promotions. The hash move is then ignored.
+   */
+  MovePicker(const Board &board, U16 hash_move = 0, const MoveHistory *history = nullptr,
+             int ply = 0, U16 prev_move = 0, bool captures_only = false);
+
+  /**
+   * @brief Get the next move.
+   *
+   * @return The next legal move as an extended move (see xmove), or 0 once
+   * all moves have been returned.
+   */
+  U32 next();
+};
@@ -0,0 +1,341 @@
+#include <popl.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "board.hpp"
+#include "batchgen.hpp"
+#include "butils.hpp"
+
+/**
+ * Known leaf counts from the start position of each board type. Any change to
+ * move generation must reproduce these.
+ */
+struct PerftReference {
+    BoardType btype;
+    int depth;
+    U64 nodes;
+};
+
+const PerftReference perft_reference[] = {
+    {SEVEN_THREE, 1, 7},
+    {SEVEN_THREE, 2, 49},
+    {SEVEN_THREE, 3, 476},
+    {SEVEN_THREE, 4, 4652},
+    {SEVEN_THREE, 5, 53771},
+    {SEVEN_THREE, 6, 622173},
+
+    {EIGHT_FOUR, 1, 5},
+    {EIGHT_FOUR, 2, 25},
+    {EIGHT_FOUR, 3, 160},
+    {EIGHT_FOUR, 4, 1024},
+    {EIGHT_FOUR, 5, 8320},
+    {EIGHT_FOUR, 6, 67664},
+    {EIGHT_FOUR, 7, 653946},
+
+    {EIGHT_TWO, 1, 22},
+    {EIGHT_TWO, 2, 466},
+    {EIGHT_TWO, 3, 10236},
+    {EIGHT_TWO, 4, 225670},
+    {EIGHT_TWO, 5, 5179345},
+};
+
+/**
+ * Positions move generation once got wrong, with their legal move counts.
+ */
+struct MoveCountReference {
+    const char *position;
+    U64 moves;
+};
+
+const MoveCountReference move_count_reference[] = {
+    // double checks along two reflected rays that cross: one piece placed
+    // on the crossing blocks both
+    {"8_4 R7/5Brk/3p/4/P1b1/3p/1P1K4/2RP1P2 b", 1},   // g7g8
+    {"8_2 5R2/1r5K/4b3/6/6/8/8/1k4p1 w", 4},          // f8f7 and three king moves
+};
+
+/**
+ * Position strings str_to_position must reject.
+ */
+const char *invalid_positions[] = {
+    "8_4 R7/5Br1/3p/4/P1b1/3p/1P1K4/2RP1P2 b",        // no black king
+    "8_4 R7/5Br1/3p/4/P1b1/3p/1P6/2RP1P2 w",          // no kings
+    "8_4 R7/5Brk/3p/4/P1b1/3p/1PK1K3/2RP1P2 b",       // two white kings
+};
+
+const char *board_type_name(BoardType btype) {
+    if (btype == SEVEN_THREE) return "7_3";
+    if (btype == EIGHT_FOUR) return "8_4";
+    return "8_2";
+}
+
+/**
+ * Counts the leaves of the legal move tree of b to the given depth. The last
+ * ply is counted from the size of the move list without making the moves.
+ */
+U64 perft(Board &b, int depth) {
+
+    MoveList moves;
+    b.get_legal_moves(moves);
+    if (depth <= 1) return depth == 1 ? moves.size() : 1;
+
+    U64 nodes = 0;
+    for (U16 m : moves) {
+        b.do_move_(m);
+        nodes += perft(b, depth - 1);
+        b.undo_move_(m);
+    }
+    return nodes;
+}
+
+/**
+ * Like perft, printing the leaf count below each root move.
+ */
+U64 divide(Board &b, int depth) {
+
+    MoveList moves;
+    b.get_legal_moves(moves);
+
+    U64 nodes = 0;
+    for (U16 m : moves) {
+        b.do_move_(m);
+        U64 n = perft(b, depth - 1);
+        b.undo_move_(m);
+        std::cout << move_to_str(m) << ": " << n << std::endl;
+        nodes += n;
+    }
+    return nodes;
+}
+
+/**
+ * Games played by check_undo, and their length.
+ */
+const int undo_games = 200;
+const int undo_plies = 200;
+
+/**
+ * Plays random games from the start position (with a fixed seed) and, in
+ * every position reached, makes and unmakes each legal move, checking that
+ * the position is restored byte for byte. Promotions are reached often
+ * enough in these games to be covered. Returns the number of moves that did
+ * not restore it.
+ */
+int check_undo(BoardType btype) {
+
+    std::mt19937 rng(btype);
+    int failures = 0;
+    for (int game=0; game<undo_games; game++) {
+        Board b(btype);
+        for (int ply=0; ply<undo_plies; ply++) {
+            MoveList moves;
+            b.get_legal_moves(moves);
+            if (moves.empty()) break;
+
+            for (U16 m : moves) {
+                BoardData before;
+                memcpy(&before, &b.data, sizeof(BoardData));
+                b.do_move_(m);
+                b.undo_move_(m);
+                if (memcmp(&before, &b.data, sizeof(BoardData))) {
+                    if (!failures) std::cout << "undo of " << move_to_str(m) << " changed " << position_to_str(&before) << std::endl;
+                    failures++;
+                }
+            }
+            b.do_move_(moves[rng() % moves.size()]);
+        }
+    }
+    return failures;
+}
+
+/**
+ * Checks generate_batch_moves against Board::get_legal_moves on the
+ * positions of random games (as check_undo plays them) and the positions of
+ * move_count_reference of the board type. Returns the number of positions
+ * whose move sets differ.
+ */
+int check_batch(BoardType btype) {
+
+    std::vector<BoardData> positions;
+    std::mt19937 rng(btype);
+    for (int game=0; game<undo_games; game++) {
+        Board b(btype);
+        for (int ply=0; ply<undo_plies; ply++) {
+            MoveList moves;
+            b.get_legal_moves(moves);
+            if (moves.empty()) break;
+            positions.push_back(b.data);
+            b.do_move_(moves[rng() % moves.size()]);
+        }
+    }
+    for (const MoveCountReference &r : move_count_reference) {
+        BoardData data;
+        if (str_to_position(r.position, &data) && data.board_type == btype) positions.push_back(data);
+    }
+
+    PositionBatch batch(btype);
+    for (const BoardData &data : positions) batch.add(data);
+    MoveBatch out;
+    generate_batch_moves(batch, out);
+
+    int failures = 0;
+    for (int i=0; i<batch.size(); i++) {
+        MoveList moves;
+        Board(positions[i]).get_legal_moves(moves);
+        std::vector<U16> expected(moves.begin(), moves.end());
+        std::vector<U16> got(out.moves_of(i), out.moves_of(i) + out.counts[i]);
+        std::sort(expected.begin(), expected.end());
+        std::sort(got.begin(), got.end());
+        if (got != expected) {
+            if (!failures) std::cout << "batch moves differ in " << position_to_str(&positions[i]) << std::endl;
+            failures++;
+        }
+    }
+    return failures;
+}
+
+/**
+ * Runs perft (or divide) on b and prints the count and speed. Returns the
+ * leaf count.
+ */
+U64 run(Board &b, int depth, bool show_divide) {
+
+    auto start = std::chrono::steady_clock::now();
+    U64 nodes = show_divide ? divide(b, depth) : perft(b, depth);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << board_type_name(b.data.board_type) << " depth " << depth << ": "
+              << nodes << " nodes, " << elapsed.count() << "s, "
+              << (U64)(nodes / std::max(elapsed.count(), 1e-9)) << " nodes/s" << std::endl;
+    return nodes;
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Rollerball perft");
+    std::string board_name, moves_str, position_str;
+    int depth;
+    auto help_op = op.add<popl::Switch>("h", "help", "show this message");
+    auto board_op = op.add<popl::Value<std::string>>("b", "board", "board type: 7_3, 8_4 or 8_2 (default: all)", "", &board_name);
+    auto depth_op = op.add<popl::Value<int>>("d", "depth", "search depth (default: deepest reference count)", 0, &depth);
+    auto moves_op = op.add<popl::Value<std::string>>("m", "moves", "space separated moves to play from the start (or given) position", "", &moves_str);
+    auto position_op = op.add<popl::Value<std::string>>("p", "position", "start from a position in the notation of position_to_str", "", &position_str);
+    auto divide_op = op.add<popl::Switch>("", "divide", "print the count below each root move");
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+
+    if (board_op->is_set() && board_name != "7_3" && board_name != "8_4" && board_name != "8_2") {
+        std::cout << "ERROR: unknown board type " << board_name << std::endl;
+        return 1;
+    }
+
+    BoardData position;
+    if (position_op->is_set()) {
+        if (!str_to_position(position_str, &position)) {
+            std::cout << "ERROR: could not parse position " << position_str << std::endl;
+            return 1;
+        }
+        board_name = board_type_name(position.board_type);
+    }
+    bool one_board = board_op->is_set() || position_op->is_set();
+
+    int failures = 0;
+    for (BoardType btype : {SEVEN_THREE, EIGHT_FOUR, EIGHT_TWO}) {
+        if (one_board && board_name != board_type_name(btype)) continue;
+
+        Board b(btype);
+        if (position_op->is_set()) b = Board(position);
+        std::istringstream moves_in(moves_str);
+        std::string m;
+        while (moves_in >> m) {
+            MoveList legal;
+            b.get_legal_moves(legal);
+            U16 mv = str_to_move(m);
+            if (std::find(legal.begin(), legal.end(), mv) == legal.end()) {
+                std::cout << "ERROR: illegal move " << m << " on board " << board_type_name(btype) << std::endl;
+                return 1;
+            }
+            b.do_move_(mv);
+        }
+
+        // only the start position has reference counts
+        const PerftReference *ref = nullptr;
+        for (const PerftReference &r : perft_reference) {
+            if (r.btype != btype) continue;
+            if (depth_op->is_set() ? r.depth == depth : (!ref || r.depth > ref->depth)) ref = &r;
+        }
+        if (moves_op->is_set() || position_op->is_set()) ref = nullptr;
+
+        int d = depth_op->is_set() ? depth : (ref ? ref->depth : 4);
+        U64 nodes = run(b, d, divide_op->is_set());
+
+        if (ref && ref->depth == d) {
+            if (nodes == ref->nodes) {
+                std::cout << "OK" << std::endl;
+            }
+            else {
+                std::cout << "MISMATCH: expected " << ref->nodes << std::endl;
+                failures++;
+            }
+        }
+
+        // the start position runs also check make/unmake
+        if (!moves_op->is_set() && !position_op->is_set()) {
+            int undo_failures = check_undo(btype);
+            std::cout << board_type_name(btype) << " undo round trip: ";
+            if (undo_failures) {
+                std::cout << "MISMATCH in " << undo_failures << " moves" << std::endl;
+                failures++;
+            }
+            else {
+                std::cout << "OK" << std::endl;
+            }
+        }
+
+        if (!moves_op->is_set() && !position_op->is_set()) {
+            int batch_failures = check_batch(btype);
+            std::cout << board_type_name(btype) << " batch moves: ";
+            if (batch_failures) {
+                std::cout << "MISMATCH in " << batch_failures << " positions" << std::endl;
+                failures++;
+            }
+            else {
+                std::cout << "OK" << std::endl;
+            }
+        }
+    }
+
+    if (!one_board && !moves_op->is_set() && !depth_op->is_set()) {
+        for (const MoveCountReference &r : move_count_reference) {
+            BoardData data;
+            str_to_position(r.position, &data);
+            Board b(data);
+            U64 nodes = perft(b, 1);
+            std::cout << r.position << ": " << nodes << " moves ";
+            if (nodes == r.moves) {
+                std::cout << "OK" << std::endl;
+            }
+            else {
+                std::cout << "MISMATCH: expected " << r.moves << std::endl;
+                failures++;
+            }
+        }
+        for (const char *position : invalid_positions) {
+            BoardData data;
+            bool parsed = str_to_position(position, &data);
+            std::cout << position << ": " << (parsed ? "MISMATCH: parsed" : "rejected OK") << std::endl;
+            if (parsed) failures++;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -10,8 +10,10 @@
 int main(int argc, char** argv) {
 
     popl::OptionParser op("Rollerball");
-    int port;
+    int port, threads;
     auto port_op = op.add<popl::Value<int>>("p", "port", "port number", -1, &port);
+    auto threads_op = op.add<popl::Value<int>>("t", "threads", "search threads per move", 1, &threads);
+    auto split_op = op.add<popl::Switch>("s", "split-root", "divide the root moves among the search threads");
     op.parse(argc, argv);
 
     if (port == -1) {
@@ -19,7 +21,12 @@ int main(int argc, char** argv) {
         return 0;
     }
 
-    UCIWSServer server(BOT_NAME, port);
+    if (threads < 1) {
+        std::cout << "ERROR: threads must be at least 1" << std::endl;
+        return 0;
+    }
+
+    UCIWSServer server(BOT_NAME, port, threads, split_op->is_set());
 
     server.start();
 
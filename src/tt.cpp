@@ -0,0 +1,98 @@
+#include "tt.hpp"
+#include "constants.hpp"
+
+// Entry::data layout: move in bits 0-15, score in bits 16-47, depth in bits
+// 48-55, bound in bits 56-57 and age in bits 58-63. An all-zero entry (bound
+// BOUND_NONE) is empty. Entry::key holds the position's hash XORed with
+// data, so a probe only accepts an entry whose key and data were written
+// together; entries are read and written with relaxed atomics, each word
+// once.
+
+inline U64 pack_entry(U16 move, int score, int depth, TranspositionTable::Bound bound, U8 age) {
+    return (U64)move | ((U64)(U32)score << 16) | ((U64)(U8)depth << 48)
+         | ((U64)bound << 56) | ((U64)(age & 0x3f) << 58);
+}
+
+inline U16 entry_move(U64 data)  { return data & 0xffff; }
+inline int entry_score(U64 data) { return (int)(U32)(data >> 16); }
+inline int entry_depth(U64 data) { return (data >> 48) & 0xff; }
+inline TranspositionTable::Bound entry_bound(U64 data) { return (TranspositionTable::Bound)((data >> 56) & 0x3); }
+inline U8 entry_age(U64 data)    { return data >> 58; }
+
+TranspositionTable::TranspositionTable(size_t size_mb) {
+    this->resize(size_mb);
+}
+
+TranspositionTable::~TranspositionTable() {
+    delete[] this->buckets;
+}
+
+void TranspositionTable::resize(size_t size_mb) {
+
+    size_t n = 1;
+    while (2 * n * sizeof(Bucket) <= (size_mb << 20)) n *= 2;
+    delete[] this->buckets;
+    this->buckets = new Bucket[n];
+    this->bucket_mask = n - 1;
+    this->clear();
+}
+
+void TranspositionTable::clear() {
+    for (U64 i=0; i<=this->bucket_mask; i++) {
+        for (Entry &e : this->buckets[i].entries) {
+            e.key.store(0, std::memory_order_relaxed);
+            e.data.store(0, std::memory_order_relaxed);
+        }
+    }
+    this->age = 0;
+}
+
+void TranspositionTable::new_search() {
+    this->age = (this->age + 1) & 0x3f;
+}
+
+bool TranspositionTable::probe(U64 key, Hit &hit) const {
+
+    const Bucket &bucket = this->buckets[key & this->bucket_mask];
+    for (const Entry &e : bucket.entries) {
+        U64 data = e.data.load(std::memory_order_relaxed);
+        if ((e.key.load(std::memory_order_relaxed) ^ data) != key || entry_bound(data) == BOUND_NONE) continue;
+        hit.move = entry_move(data);
+        hit.score = entry_score(data);
+        hit.depth = entry_depth(data);
+        hit.bound = entry_bound(data);
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(U64 key, int depth, Bound bound, int score, U16 move) {
+
+    Bucket &bucket = this->buckets[key & this->bucket_mask];
+
+    // the position's own entry if it has one, else the entry worth least:
+    // one from an earlier search before one from this search, then the
+    // shallowest
+    Entry *victim = nullptr;
+    int victim_worth = 0;
+    for (Entry &e : bucket.entries) {
+        U64 data = e.data.load(std::memory_order_relaxed);
+        if ((e.key.load(std::memory_order_relaxed) ^ data) == key) {
+            // keep a deeper result from this search
+            if (entry_age(data) == this->age && depth < entry_depth(data)) return;
+            victim = &e;
+            if (!move) move = entry_move(data);
+            break;
+        }
+        int worth = entry_bound(data) == BOUND_NONE ? -1
+                  : entry_depth(data) + (entry_age(data) == this->age ? 256 : 0);
+        if (!victim || worth < victim_worth) {
+            victim = &e;
+            victim_worth = worth;
+        }
+    }
+
+    U64 data = pack_entry(move, score, depth, bound, this->age);
+    victim->key.store(key ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "constants.hpp"
+
+/**
+ * @brief A fixed-size transposition table keyed by BoardData::hash.
+ *
+ * Entries are grouped in buckets of four that share a cache line; a position
+ * can only be stored in the bucket its hash selects. Each entry records the
+ * depth a position was searched to, whether its score is exact or a bound,
+ * the best move found and the search (age) that stored it. When a bucket is
+ * full, entries from earlier searches are replaced first, then the shallowest.
+ *
+ * Scores are stored as the search returns them; the table does not interpret
+ * them.
+ *
+ * The table may be shared by threads searching at once without locks: an
+ * entry stores its key XORed with its data, so an entry torn by two threads
+ * writing it together fails the key check on probe and reads as a miss.
+ */
+struct TranspositionTable {
+
+  enum Bound {
+    BOUND_NONE  = 0,
+    BOUND_UPPER = 1, /* The score is at most the stored one (fail low). */
+    BOUND_LOWER = 2, /* The score is at least the stored one (fail high). */
+    BOUND_EXACT = 3
+  };
+
+  /**
+   * @brief What a probe returns for a position.
+   */
+  struct Hit {
+    U16 move;
+    int score;
+    int depth;
+    Bound bound;
+  };
+
+  /**
+   * @brief One slot: the full hash of the position XORed with its data, and
+   * the data packed into 64 bits (move, score, depth, bound and age; see
+   * tt.cpp).
+   */
+  struct Entry {
+    std::atomic<U64> key;
+    std::atomic<U64> data;
+  };
+
+  static const int bucket_size = 4;
+
+  struct alignas(64) Bucket {
+    Entry entries[bucket_size];
+  };
+
+  Bucket *buckets = nullptr;
+  U64 bucket_mask = 0; /* Number of buckets - 1; the count is a power of two. */
+  U8 age = 0;          /* Incremented by new_search, kept in 6 bits. */
+
+  /**
+   * @brief Constructor.
+   *
+   * @param size_mb Memory for the table in megabytes, rounded down to a power
+   * of two number of buckets.
+   */
+  TranspositionTable(size_t size_mb);
+  ~TranspositionTable();
+
+  TranspositionTable(const TranspositionTable&) = delete;
+  TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+  /**
+   * @brief Reallocates the table with a new size, dropping all entries.
+   */
+  void resize(size_t size_mb);
+
+  /**
+   * @brief Drops all entries.
+   */
+  void clear();
+
+  /**
+   * @brief Starts a new search: entries stored before this call are replaced
+   * before those stored after it.
+   */
+  void new_search();
+
+  /**
+   * @brief Looks up a position.
+   *
+   * @param key The position's hash.
+   * @param hit Receives the stored data if the position is found.
+   * @return True if the position is in the table.
+   */
+  bool probe(U64 key, Hit &hit) const;
+
+  /**
+   * @brief Stores the result of searching a position.
+   *
+   * An existing entry for the position is overwritten, unless it holds a
+   * deeper result from the same search; its move is kept if move is 0.
+   *
+   * @param key The position's hash.
+   * @param depth The depth searched to, 0 - 255.
+   * @param bound How score relates to the position's true score.
+   * @param score The search score.
+   * @param move The best move found, or 0 if none.
+   */
+  void store(U64 key, int depth, Bound bound, int score, U16 move);
+};
@@ -25,9 +25,17 @@ std::vector<std::string> split(const std::string &s, char delim) {
     return elems;
 }
 
-UCIWSServer::UCIWSServer(std::string name, uint32_t port) {
+// Parses a whole token as an int; false if it is not one.
+bool parse_int(const std::string &s, int &value) {
+    std::istringstream iss(s);
+    return (iss >> value) && iss.eof();
+}
+
+UCIWSServer::UCIWSServer(std::string name, uint32_t port, int threads, bool split_root) {
     this->name = name;
     this->port = port;
+    this->threads = threads;
+    this->split_root = split_root;
 }
 
 void UCIWSServer::handle_message(ClientConnection conn, const std::string& message) {
@@ -37,6 +45,9 @@ void UCIWSServer::handle_message(ClientConnection conn, const std::string& messa
     if (toks[0] == "uci") {
         on_uci();
     }
+    else if (toks[0] == "setoption") {
+        on_setoption(toks);
+    }
     else if (toks[0] == "ucinewgame") {
         on_ucinewgame(toks);
     }
@@ -94,11 +105,35 @@ void UCIWSServer::on_uci() {
     server.broadcastMessage("uciok");
 }
 
+// setoption name <option> value <v>, from the next ucinewgame on:
+// - Threads: the number of search threads
+// - SplitRoot: true to divide the root moves among them, false for lazy SMP
+void UCIWSServer::on_setoption(std::vector<std::string>& toks) {
+    std::cout << "In method on_setoption\n";
+    if (toks.size() == 5 && toks[1] == "name" && toks[3] == "value") {
+        int threads;
+        if (toks[2] == "Threads" && parse_int(toks[4], threads) && threads >= 1) {
+            this->threads = threads;
+            return;
+        }
+        if (toks[2] == "SplitRoot" && (toks[4] == "true" || toks[4] == "false")) {
+            this->split_root = (toks[4] == "true");
+            return;
+        }
+    }
+    std::cout << "Unsupported option\n";
+}
+
 void UCIWSServer::on_ucinewgame(std::vector<std::string>& toks) {
     std::cout << "In method on_ucinewgame\n";
-    if (b == nullptr) delete b;
-    if (e == nullptr) delete e;
+    // each engine holds a transposition table of TT_SIZE_MB: free the last
+    // game's before starting a new one
+    delete b;
+    delete e;
+    b = nullptr;
     e = new Engine();
+    e->threads = this->threads;
+    e->split_root = this->split_root;
     e->time_left = std::chrono::milliseconds(stoi(toks[2]));
     if (toks[1] == "board-7-3") {
         b = new Board(SEVEN_THREE);
@@ -22,11 +22,13 @@ class UCIWSServer {
 
     uint32_t port;
     std::string name;
+    int threads;     // search threads of the next game's engine
+    bool split_root; // whether they split the root moves (else lazy SMP)
 
-    Board *b;
-    Engine *e;
+    Board *b = nullptr;
+    Engine *e = nullptr;
 
-    UCIWSServer(std::string name, uint32_t port);
+    UCIWSServer(std::string name, uint32_t port, int threads = 1, bool split_root = false);
 
     void start();
     void stop();
@@ -35,6 +37,7 @@ class UCIWSServer {
 
     void on_uci();
     void on_isready();
+    void on_setoption(std::vector<std::string>& toks);
     void on_ucinewgame(std::vector<std::string>& toks);
     void on_position(std::vector<std::string>& toks);
     void on_go(std::vector<std::string>& toks);
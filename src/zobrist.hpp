@@ -0,0 +1,52 @@
+#pragma once
+
+#include "bdata.hpp"
+#include "constants.hpp"
+
+// index of a piece (colour | type) in ZobristKeys::piece
+#define zobrist_piece(p) (coloridx(p) * 5 + pieceidx(p))
+
+/**
+ * Zobrist keys for BoardData::hash. The keys are generated at compile time
+ * from a fixed seed with splitmix64, so hashes are stable across runs and
+ * builds and can be stored.
+ */
+struct ZobristKeys {
+
+  // Keys for a piece on a square, indexed by zobrist_piece(piece) and square.
+  // Promoted pawns hash as the piece they promoted to.
+  U64 piece[10][64] = {};
+
+  // Key xor'ed in when black is to play.
+  U64 black_to_play = 0;
+
+  // Starting key of each BoardType (index 0 is unused).
+  U64 board_type[4] = {};
+};
+
+constexpr U64 splitmix64(U64 &state) {
+    U64 z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys make_zobrist_keys() {
+
+    ZobristKeys keys;
+    U64 state = 0x726f6c6c657262ULL;
+
+    for (int p=0; p<10; p++) {
+        for (int sq=0; sq<64; sq++) {
+            keys.piece[p][sq] = splitmix64(state);
+        }
+    }
+    keys.black_to_play = splitmix64(state);
+    for (int bt=0; bt<4; bt++) {
+        keys.board_type[bt] = splitmix64(state);
+    }
+
+    return keys;
+}
+
+inline constexpr ZobristKeys zobrist_keys = make_zobrist_keys();